@@ -7,11 +7,12 @@
 
 class GmAST;
 
+/* Instructions of one block. A view: the script's code must outlive it. */
 class BaseBlock
 {
 public:
     BaseBlock();
-    BaseBlock(const std::vector<AsmCommand>& p);
+    BaseBlock(const AsmCommand* first, const AsmCommand* last);
 
     int addr() const;
     int pastTheEndAddr() const;
@@ -30,11 +31,15 @@ public:
     bool isNop() const;
     bool valid() const;
 
-    const auto begin() const { return code_.begin(); }
-    const auto end() const { return code_.end(); }
+    const AsmCommand* begin() const { return first_; }
+    const AsmCommand* end() const { return last_; }
 
 private:
-    std::vector<AsmCommand> code_;
+    const AsmCommand* first_;
+    const AsmCommand* last_;
+
+    size_t size() const;
+    const AsmCommand& back() const;
 };
 
 #endif // BASEBLOCK_H
@@ -54,8 +54,9 @@ public:
     ControlTree* rightLeaf();
     ControlTree* leaf(int index = 0);
 
-    friend std::ostream& operator<< (std::ostream& out, const ControlTree& t);
+    void print(std::ostream& out, const GmForm* f, int depth = 0) const;
     friend class GraphmlWriter;
+    friend class StepTraceWriter;
 
 private:
     Type type_;
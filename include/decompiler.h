@@ -4,14 +4,19 @@
 #include <string>
 #include <set>
 #include <map>
+#include <iosfwd>
+#include <cstdint>
 
 #include "controltree.h"
+#include "flowgraph.h"
 #include "gmast.h"
 
 
 class GmForm;
 class ScriptEntry;
 class GmxProject;
+class Scheduler;
+class Manifest;
 
 
 class Decompiler
@@ -25,7 +30,13 @@ public:
         bool logFlowgraph;
         bool logTree;
         bool logAssembly;
+        bool logStats;
         bool decompileAll;
+        int maxSteps;     // Reductions per script, 0 for no limit
+        int timeLimitMs;  // Per script, 0 for no limit
+        int threads;      // Scripts decompiled at once, 0 for one per core
+        bool dedup;       // Identical scripts are decompiled once
+        const Manifest* previous;  // Scripts it lists with the same hash are kept as they are
 
         static Options Debug();
         static Options Release();
@@ -33,6 +44,10 @@ public:
         inline bool logAnything() const { return logAssembly || logFlowgraph || logTree; }
     };
 
+    /* Bumped whenever the same bytecode decompiles to different GML,
+     * so manifests of earlier builds are not trusted */
+    static const int OutputVersion = 1;
+
     static const std::map<Operation, std::string> AsmOpToBinary;
     static const std::map<Operation, std::string> AsmOpToUnary;
     static const std::map<Operation, std::string> AsmOpToRelative;
@@ -42,7 +57,8 @@ public:
 
     Decompiler(GmForm& f);
 
-    void decompile(GmxProject& proj);
+    /* Scripts decompiled or kept are listed in 'manifest' */
+    void decompile(GmxProject& proj, Manifest* manifest = nullptr);
 
 private:
     struct Frame
@@ -52,14 +68,43 @@ private:
         std::vector<GmAST::ptr_t> stat_list;
     };
 
+    /* Outcome of one script, kept until earlier ones are reported */
+    struct Result
+	{
+        GmAST::ptr_t tree;
+        std::string log;  // Messages, if not printed right away
+        bool fallback = false;
+    };
+
     GmForm* form_;
     std::vector<Frame> stack_;
     GmAST::ptr_t addr_;
     GmAST::ptr_t index_;
     GmAST::ptr_t ret_expr_;
-
+    FlowGraph::stats_t stats_;
+    std::vector<std::string> fallbacks_;
+    std::ostream* log_;  // Messages of the current script
+    bool fallback_;      // Current script was written as raw blocks
+
+    /* Relative time to decompile, for scheduling */
+    static uint64_t EstimateCost(ScriptEntry const& src);
+
+    bool skipped(ScriptEntry const& src) const;
+    /* Instructions with symbols and strings resolved and no addresses:
+     * equal for scripts that decompile to the same code */
+    std::string bodyKey(ScriptEntry const& src) const;
+    /* Index of the first script with the same body, by script. Kept
+     * scripts are not decompiled, so never stand for others */
+    std::vector<int> groupBodies(std::vector<uint64_t> const& hashes, std::vector<char> const& kept) const;
+    Result decompileEntry(ScriptEntry const& src, std::ostream& log);
+    Result duplicate(ScriptEntry const& src, ScriptEntry const& of, Result const& res);
+    /* With 'keep' the project gets a copy and the tree stays in 'res' */
+    void report(ScriptEntry const& src, Result& res, GmxProject& proj, bool keep = false);
     GmAST::ptr_t decompileScript(ScriptEntry const& src);
+    GmAST::ptr_t fallbackScript(ScriptEntry const& src);
     GmAST::ptr_t analyzeControlTree(ControlTree* ct);
+    void printStats() const;
+    void printUtilisation(Scheduler const& sched) const;
     void visit(ControlTree* ct, bool as_block = false, bool push_into = false);
     void decompileBaseBlock(const BaseBlock& bb);
     void applyCommand(const AsmCommand& cmd);
@@ -0,0 +1,39 @@
+#ifndef DOMINATORS_H
+#define DOMINATORS_H
+
+#include <deque>
+#include <vector>
+
+#include "flowgraph.h"
+
+
+/* Dominator tree of a FlowGraph (Cooper, Harvey, Kennedy: "A Simple, Fast
+ * Dominance Algorithm"). With 'post' set the tree is built over reversed
+ * links, rooted at a virtual exit joining all nodes without outputs. */
+class Dominators
+{
+public:
+    using Node = FlowGraph::Node;
+
+    Dominators(std::deque<Node> const& nodes, const Node* entry, bool post);
+
+    /* Nodes created after the tree was built are never reachable */
+    bool reachable(const Node* n) const;
+    bool dominates(const Node* a, const Node* b) const;
+    /* Position in depth-first postorder, dominators rank higher */
+    int rank(const Node* n) const;
+    /* Null for the root, the virtual exit and unreachable nodes */
+    Node* immediate(const Node* n) const;
+    /* Nearest node dominating both, null if only the virtual exit does */
+    Node* common(const Node* a, const Node* b) const;
+
+private:
+    std::vector<Node*> byId_;
+    std::vector<int> idom_;       // By id, -1 if unreachable
+    std::vector<int> postorder_;  // By id
+    int root_;
+
+    int intersect(int a, int b) const;
+};
+
+#endif // DOMINATORS_H
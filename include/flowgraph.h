@@ -6,13 +6,20 @@
 #include <string>
 #include <map>
 #include <set>
-#include <stack>
 #include <iostream>
 #include <memory>
+#include <deque>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
 
 #include "asmcommand.h"
 #include "controltree.h"
+#include "smallvector.h"
 
+class Dominators;
+class StepTraceWriter;
 
 class FlowGraph
 {
@@ -24,10 +31,33 @@ public:
         None, Break, Continue
     };
 
+    /* Reduction patterns, in the order they are tried */
+    enum class Pattern
+	{
+        Block, And, Or, Switch, If, IfElse, Repeat, Loop, NaturalLoop, Count
+    };
+
+    struct PatternStats
+	{
+        /* Matcher calls while reducing */
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        /* Matcher calls while looking for nodes to reduce */
+        uint64_t probeHits = 0;
+        uint64_t probeMisses = 0;
+    };
+    using stats_t = std::array<PatternStats, static_cast<size_t>(Pattern::Count)>;
+
+    static const char* PatternName(Pattern p);
+
     struct Options
 	{
-        std::string stepLogPrefix;
+        std::string traceFile;  // Step trace, written if logSteps is set
+        const GmForm* form;
+        std::ostream* log;  // Reduction failures
         bool logSteps;
+        int maxSteps;                         // Reductions per script, 0 for no limit
+        std::chrono::milliseconds timeLimit;  // Per script, 0 for no limit
 
         static Options Debug();
         static Options Release();
@@ -35,14 +65,18 @@ public:
 
     struct Node
 	{
-        typedef std::unique_ptr<Node> ptr_t;
+        /* Most blocks have at most two successors */
+        using links_t = SmallVector<Node*, 2>;
 
-        std::vector<Node*> inputs, outputs;
+        links_t inputs, outputs;
         ControlTree::ptr_t tree;
         const int addr;
         const int pastTheEndAddr;
+        int order;  // Position in depth-first walk, -1 if unreachable
+        int id;     // Index in the graph arena
+        int loop;   // Loop headed by this node, -1 if none
+        bool alive;
 
-        Node() = default;
         Node(int addr);
         Node(ControlTree::ptr_t ct);
 
@@ -63,55 +97,148 @@ public:
 
     FlowGraph();
     FlowGraph(const program_t& cv);
+    ~FlowGraph();
 
     void analyze();
     ControlTree* controlTree();
+    const stats_t& stats() const;
+    /* Reduction stopped on the step or time budget */
+    bool exhausted() const;
 
     friend class GraphmlWriter;
+    friend class StepTraceWriter;
 
 private:
     Node* entry_;
-    std::vector<Node::ptr_t> nodes_;
+    /* Nodes are never moved, erased ones stay as tombstones */
+    std::deque<Node> nodes_;
+    int liveCount_;
+
+    std::unique_ptr<StepTraceWriter> trace_;
+    Pattern lastMatch_;  // Applied by the last reduction
+    void logSelf(Pattern p);
+
+    /* Loop nesting forest, built once before reduction. Inner loops
+     * come before the loops enclosing them. */
+    struct Loop
+	{
+        Node* header;
+        Node* bottom;   // Last latch in code order
+        Node* exit;     // Where breaks go
+        int parent;     // Enclosing loop, -1 for outermost ones
+    };
+    std::vector<Loop> loops_;
 
-    int step_;
-    void logSelf();
+    /* Reduction worklist: nodes known to match, keyed by walk order */
+    std::map<int, Node*> matching_;
+    std::set<Node*> switchHeaders_;
+    std::vector<Node*> touched_;
+    bool tracking_;
+    bool orderStale_;
 
-    bool matchedBlock(Node* n);
-    bool matchedLoop(Node* n);
-    bool matchedNaturalLoop(Node* n);
-    bool matchedRepeat(Node* n);
-    bool matchedIf(Node* n);
-    bool matchedIfElse(Node* n);
-    bool matchedAnd(Node* n);
-    bool matchedOr(Node* n);
-    bool matchedSwitch(Node* n);
+    /* Nodes by id as a bitset, storage is kept when emptied */
+    class NodeSet
+	{
+    public:
+        /* Empties the set, sized for ids below 'count' */
+        void reset(size_t count)
+        {
+            bits_.assign((count + 63) / 64, 0);
+        }
+
+        /* False if the node was already there */
+        bool insert(const Node* n)
+        {
+            size_t word = n->id / 64;
+            if (word >= bits_.size())
+			{
+                bits_.resize(word + 1, 0);
+            }
+            uint64_t bit = uint64_t(1) << (n->id % 64);
+            bool added = !(bits_[word] & bit);
+            bits_[word] |= bit;
+            return added;
+        }
+
+        void erase(const Node* n)
+        {
+            bits_[n->id / 64] &= ~(uint64_t(1) << (n->id % 64));
+        }
+
+    private:
+        std::vector<uint64_t> bits_;
+    };
+
+    /* Traversal state shared by walks over the graph, so that repeated
+     * ones do not allocate. Walks must not nest. */
+    struct Scratch
+	{
+        std::vector<Node*> stack;
+        NodeSet seen;
+    };
+    Scratch walk_;
+    Scratch dirty_;
+
+    /* Matcher calls by pattern */
+    stats_t stats_;
+    bool exhausted_;
+
+    bool outOfBudget(int steps, std::chrono::steady_clock::time_point start) const;
+
+    unsigned candidates(Node* n) const;
+    bool tryMatch(Node* n, bool apply);
+    void renumber();
+    void requeue();
+    void touch(Node* n);
+
+    bool matchedBlock(Node* n, bool apply = true);
+    bool matchedLoop(Node* n, bool apply = true);
+    bool matchedNaturalLoop(Node* n, bool apply = true);
+    bool matchedRepeat(Node* n, bool apply = true);
+    bool matchedIf(Node* n, bool apply = true);
+    bool matchedIfElse(Node* n, bool apply = true);
+    bool matchedAnd(Node* n, bool apply = true);
+    bool matchedOr(Node* n, bool apply = true);
+    bool matchedSwitch(Node* n, bool apply = true);
 
     void cleanupNops();
-    void rerouteBreakContinue();
+    void findLoops(Dominators const& dom, Dominators const& postDom);
+    void rerouteBreakContinue(Dominators const& dom);
     void analyzeImpl();
     void eraseNode(Node* n);
     void insertBefore(Node* pos, Node* val);
     Node* fallthroughNode(Node* n);
     Node* createEmptyTerminal(int addr = -1);
-    Node* createTerminal(program_t& p);
+    Node* createTerminal(const AsmCommand* first, const AsmCommand* last);
+
+    template< class... Args >
+    Node* createNode(Args&&... args)
+    {
+        nodes_.emplace_back(std::forward<Args>(args)...);
+        Node* ret = &nodes_.back();
+        ret->id = nodes_.size() - 1;
+        ++liveCount_;
+        return ret;
+    }
 
-    static bool addLink(Node* a, Node* b);
+    bool addLink(Node* a, Node* b);
     static bool hasLink(Node* a, Node* b);
     static bool linkIsUp(Node* a, Node* b);
-    static bool removeLink(Node* a, Node* b);
+    bool removeLink(Node* a, Node* b);
 
     template< class Fun >
     void depthFirstWalk(Node* entry, Fun visitor)
     {
-        std::stack<Node*> store;
-        std::set<Node*> visited;
-        store.push(entry);
-        visited.insert(entry);
+        std::vector<Node*>& store = walk_.stack;
+        store.clear();
+        walk_.seen.reset(nodes_.size());
+        store.push_back(entry);
+        walk_.seen.insert(entry);
 
         while (!store.empty())
 		{
-            Node* node = store.top();
-            store.pop();
+            Node* node = store.back();
+            store.pop_back();
 
             VisitResult result = visitor(node);
             if (result == VisitResult::Continue) { continue; }
@@ -119,9 +246,9 @@ private:
 
             for (Node* l : node->outputs)
 			{
-                if (visited.insert(l).second)
+                if (walk_.seen.insert(l))
 				{
-                    store.push(l);
+                    store.push_back(l);
                 }
             }
         }
@@ -144,16 +271,34 @@ private:
             ct->addLeaf(std::move((*it)->tree));
         }
 
-        auto newHdr = std::make_unique<Node>(std::move(ct));
-        insertBefore(*first, newHdr.get());
+        Node* newHdr = createNode(std::move(ct));
+
+        /* Walk order survives if the head is the only way into the group */
+        newHdr->order = (*first)->order;
+        newHdr->loop = (*first)->loop;
+        for (It it = std::next(first); it != last; ++it)
+		{
+            for (Node* in : (*it)->inputs)
+			{
+                if (std::find(first, last, in) == last)
+				{
+                    orderStale_ = true;
+                }
+            }
+        }
+        if (newHdr->tree->isSwitchHeader())
+		{
+            switchHeaders_.insert(newHdr);
+        }
+
+        insertBefore(*first, newHdr);
 
         for (It it = first; it != last; ++it)
 		{
             eraseNode(*it);
         }
 
-        nodes_.push_back(std::move(newHdr));
-        return nodes_.back().get();
+        return newHdr;
     }
 };
 
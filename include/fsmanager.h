@@ -9,6 +9,11 @@ class FsManager
 public:
     static void directoryCreate(const std::wstring& path);
     static void directoryDelete(const std::wstring& path);
+    /* A missing file is not an error */
+    static void fileDelete(const std::wstring& path);
+    /* Moves 'from' over 'to' in one step: readers of 'to' see either the
+     * old file or the new one. Both must be on the same volume */
+    static void fileReplace(const std::wstring& from, const std::wstring& to);
 };
 
 #endif // FSMANAGER_H
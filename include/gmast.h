@@ -44,6 +44,7 @@ enum class GmlPattern
     SwitchCase,
     SwitchDefault,
     With,
+    Comment,
 };
 
 const char* GmlPattern2String(GmlPattern p);
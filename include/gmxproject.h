@@ -17,6 +17,7 @@ public:
         bool separateScripts = true;
         std::string codeDir = ".";
         std::string scriptsDir = "scripts";
+        int threads = 1;  // Files written at once, 0 for one per core
     };
 
     struct GmlScript
@@ -34,10 +35,16 @@ public:
     void exportGmx(GmForm&, std::string const& dir);
 
     void addCode(std::string const& full_name, GmAST::ptr_t ast);
+    /* File of the code, written by an earlier run, is deleted on export */
+    void dropCode(std::string const& full_name);
 
 private:
     std::map<std::string, GmlScript> scripts_;
     std::map<std::string, GmAST::ptr_t> codes_;
+    std::vector<std::string> dropped_;
+
+    /* Past the "gml_Script_" prefix, null for other code */
+    static const char* ScriptName(std::string const& full_name);
 };
 
 #endif // GMXPROJECT_H
@@ -0,0 +1,40 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "decompiler.h"
+
+class GmForm;
+
+
+/* Content hash of every script a run wrote or kept. Given the manifest of
+ * the previous run, only scripts whose hash changed are decompiled again.
+ * The file is plain text, one "<hash> <name>" line per script. */
+class Manifest
+{
+public:
+    /* Hash of what shapes the output besides the bytecode: resource names
+     * GML refers to, the budgets and the decompiler output version. It is
+     * folded into every script hash, so changing any of them rewrites all. */
+    static uint64_t Key(GmForm const& f, Decompiler::Options const& opt);
+
+    /* Empty if the file is missing or of another version */
+    static Manifest Read(std::string const& path);
+
+    void write(std::string const& path) const;
+
+    bool empty() const;
+    /* Listed with the same hash */
+    bool contains(std::string const& name, uint64_t hash) const;
+    void add(std::string const& name, uint64_t hash);
+
+    std::map<std::string, uint64_t> const& scripts() const;
+
+private:
+    std::map<std::string, uint64_t> scripts_;
+};
+
+#endif // MANIFEST_H
@@ -0,0 +1,58 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+/* Runs a batch of tasks of known relative cost on a fixed number of
+ * workers. Tasks are dealt to per-worker queues largest first, evening
+ * out the cost per queue. A worker whose queue runs dry steals the
+ * largest task left in the most loaded queue. */
+class Scheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct WorkerStats
+    {
+        int tasks = 0;
+        int stolen = 0;
+        Clock::duration busy = Clock::duration::zero();
+    };
+
+    /* 0 threads means one per hardware core */
+    explicit Scheduler(int threads = 0);
+
+    int size() const;
+
+    /* Calls fun(worker, task) once per task index, returns when all are done */
+    void run(std::vector<uint64_t> const& costs, std::function<void(int, int)> const& fun);
+
+    /* Of the last run */
+    std::vector<WorkerStats> const& stats() const;
+    Clock::duration elapsed() const;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;  // Largest first
+        uint64_t cost = 0;      // Of the tasks still queued
+    };
+
+    int threads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<WorkerStats> stats_;
+    Clock::duration elapsed_;
+
+    bool take(std::vector<uint64_t> const& costs, int worker, int& task);
+    static bool pop(Queue& q, std::vector<uint64_t> const& costs, int& task);
+};
+
+#endif // SCHEDULER_H
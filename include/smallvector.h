@@ -0,0 +1,126 @@
+#ifndef SMALLVECTOR_H
+#define SMALLVECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+
+/* Vector of trivially copyable items keeping the first N in place.
+ * Not copyable: elements may point into the owning object. */
+template<class T, size_t N>
+class SmallVector
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector holds plain items only");
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector()
+        : data_(inline_)
+        , size_(0)
+        , capacity_(N)
+    {}
+
+    ~SmallVector()
+    {
+        release();
+    }
+
+    SmallVector(const SmallVector&) = delete;
+    SmallVector& operator= (const SmallVector&) = delete;
+
+    iterator begin()             { return data_; }
+    iterator end()               { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end()   const { return data_ + size_; }
+
+    size_t size()  const { return size_; }
+    bool   empty() const { return size_ == 0; }
+
+    T&       operator[](size_t i)       { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    T& front() { return data_[0]; }
+    T& back()  { return data_[size_ - 1]; }
+
+    T& at(size_t i)
+    {
+        if (i >= size_)
+        {
+            throw std::out_of_range("SmallVector::at");
+        }
+        return data_[i];
+    }
+
+    void push_back(T v)
+    {
+        reserve(size_ + 1);
+        data_[size_++] = v;
+    }
+
+    iterator insert(iterator pos, T v)
+    {
+        size_t i = pos - data_;
+        reserve(size_ + 1);
+        std::memmove(data_ + i + 1, data_ + i, (size_ - i) * sizeof(T));
+        data_[i] = v;
+        ++size_;
+        return data_ + i;
+    }
+
+    iterator erase(iterator pos)
+    {
+        size_t i = pos - data_;
+        std::memmove(data_ + i, data_ + i + 1, (size_ - i - 1) * sizeof(T));
+        --size_;
+        return data_ + i;
+    }
+
+    void clear()
+    {
+        size_ = 0;
+    }
+
+    /* Drops heap storage, if any */
+    void shrink()
+    {
+        release();
+        data_ = inline_;
+        size_ = 0;
+        capacity_ = N;
+    }
+
+    void reserve(size_t n)
+    {
+        if (n <= capacity_)
+        {
+            return;
+        }
+        size_t cap = capacity_ * 2 < n ? n : capacity_ * 2;
+        T* p = new T[cap];
+        std::memcpy(p, data_, size_ * sizeof(T));
+        release();
+        data_ = p;
+        capacity_ = cap;
+    }
+
+private:
+    T* data_;
+    uint32_t size_;
+    uint32_t capacity_;
+    T inline_[N];
+
+    void release()
+    {
+        if (data_ != inline_)
+        {
+            delete[] data_;
+        }
+    }
+};
+
+#endif // SMALLVECTOR_H
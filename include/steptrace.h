@@ -0,0 +1,88 @@
+#ifndef STEPTRACE_H
+#define STEPTRACE_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flowgraph.h"
+#include "binaryreader.h"
+
+class GmForm;
+
+
+/* Record of FlowGraph reduction, one step at a time. The first step holds
+ * every live node; the following ones only the nodes made and erased, the
+ * output lists that changed and the pattern applied. Trees of known nodes
+ * are written as references, so each instruction is printed once. */
+class StepTraceWriter
+{
+public:
+    StepTraceWriter(std::string const& path, const GmForm* f);
+
+    /* Appends the changes since the previous call */
+    void step(FlowGraph const& g, FlowGraph::Pattern p);
+    /* Called before the node is erased */
+    void erase(FlowGraph::Node const& n);
+
+private:
+    std::ofstream out_;
+    const GmForm* form_;
+    size_t count_;  // Graph size at the previous step
+    /* Trees of live nodes as of the previous step */
+    std::unordered_map<const ControlTree*, int> known_;
+    std::vector<const ControlTree*> treeOf_;
+    std::vector<int> erased_;
+    std::vector<char> written_;
+
+    void writeTree(const ControlTree& t);
+    void writeOutputs(FlowGraph::Node const& n);
+    void writeU8(uint8_t v);
+    void writeU32(uint32_t v);
+};
+
+
+/* Rebuilds the graph at any step of a trace */
+class StepTraceReader
+{
+public:
+    struct Tree
+	{
+        ControlTree::Type type;
+        std::vector<std::shared_ptr<const Tree>> leaves;
+        std::vector<std::string> lines;  // Instructions of a terminal
+    };
+
+    struct Node
+	{
+        std::shared_ptr<const Tree> tree;
+        std::vector<int> outputs;
+        bool alive = false;
+    };
+    using graph_t = std::vector<Node>;  // By node id
+
+    static const int NoPattern = 0xff;
+
+    explicit StepTraceReader(std::string const& path);
+
+    int steps() const;
+    /* Pattern applied on the step, NoPattern on the first one */
+    int pattern(int step) const;
+    graph_t graph(int step) const;
+
+    /* Same text as ControlTree::print */
+    static void print(std::ostream& out, const Tree& t, int depth = 0);
+
+private:
+    BinaryReader file_;
+    std::vector<int> patterns_;
+
+    /* Applies records up to the end of the step, returns its pattern */
+    int replay(BinaryReader& br, graph_t& g) const;
+    std::shared_ptr<const Tree> readTree(BinaryReader& br, graph_t const& g) const;
+};
+
+#endif // STEPTRACE_H
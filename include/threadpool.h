@@ -0,0 +1,51 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+
+class ThreadPool
+{
+public:
+    /* 0 threads means one per hardware core */
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator= (const ThreadPool&) = delete;
+
+    static int HardwareThreads();
+
+    int size() const;
+
+    template<class Fun>
+    std::future<void> submit(Fun fun)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::move(fun));
+        std::future<void> ret = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push([task]() { (*task)(); });
+        }
+        cv_.notify_one();
+        return ret;
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+
+    void run();
+};
+
+#endif // THREADPOOL_H
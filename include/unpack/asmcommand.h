@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <type_traits>
 
 #include "utils.h"
 
@@ -126,19 +127,21 @@ private:
 };
 
 
+/* Packed instruction record. Operand slot of Call and variable
+ * instructions holds an index into FUNC/VARI tables once resolved. */
 struct AsmCommand
 {
     static const uint32_t SaveStateHigh16;
+    static const uint32_t NoSymbol;
 
-    int addr, size;
+    int32_t addr;
     uint32_t data;
     uint32_t extra[2];
-    std::string text;
-    std::string symbol;
 
     AsmCommand();
-    AsmCommand(BinaryReader& br);
+    AsmCommand(int addr, const uint32_t* words, size_t avail);
 
+    int size() const;
     Operation operation() const;
     Comparison cmpType() const;
     TypePair typePair() const;
@@ -151,26 +154,225 @@ struct AsmCommand
     float dataFloat() const;
     double dataDouble() const;
     ScopedVariable variable() const;
-    std::string const& toString() const;
+    bool refersVariable() const;
+    bool hasSymbol() const;
+    uint32_t symbolIndex() const;
 
-    void initText(const GmForm* f);
+    void symbolIndex(uint32_t idx);
+    void print(std::ostream& out, const GmForm& f) const;
+};
+
+static_assert(sizeof(AsmCommand) == 16, "AsmCommand must stay packed");
+static_assert(std::is_trivially_copyable<AsmCommand>::value, "AsmCommand must stay POD-like");
+
+/* ****************** *
+ * Opcode descriptors *
+ * ****************** */
+enum class OperandRule : uint8_t
+{
+    None,       // Single word
+    Typed,      // Operand words follow, count depends on DataType
+};
 
-    friend std::ostream& operator<< (std::ostream& out, const AsmCommand& cmd);
+enum class OpClass : uint8_t
+{
+    Invalid,
+    Binary,     // pops 2, pushes 1
+    Unary,      // pops 1, pushes 1
+    Compare,    // pops 2, pushes 1
+    Convert,    // pops 1, pushes 1
+    Push,       // pushes 1
+    Store,      // pops value (and instance/index)
+    Call,       // pops argc, pushes 1
+    Duplicate,  // pushes copy of top
+    Drop,       // pops 1
+    Jump,
+    CondJump,   // pops 1
+    Env,
+    Return,     // pops 1
+    Exit,
+    Break,
+    Save,
 };
 
+struct OpcodeInfo
+{
+    char name[12];
+    char pretty[12];
+    OperandRule operand;
+    OpClass cls;
+};
+
+struct DataTypeInfo
+{
+    char name[12];
+    char pretty[12];
+    uint8_t operandSize;
+};
+
+namespace detail
+{
+    template<size_t N>
+    constexpr void copyName(char (&dest)[N], const char* src)
+    {
+        size_t i = 0;
+        for (; i + 1 < N && src[i]; ++i)
+        {
+            dest[i] = src[i];
+        }
+        dest[i] = '\0';
+    }
+
+    template<size_t N>
+    constexpr void lowerName(char (&dest)[N], const char* src)
+    {
+        size_t i = 0;
+        for (; i + 1 < N && src[i]; ++i)
+        {
+            dest[i] = (src[i] >= 'A' && src[i] <= 'Z') ? src[i] - 'A' + 'a' : src[i];
+        }
+        dest[i] = '\0';
+    }
+}
+
+class OpcodeTable
+{
+public:
+    constexpr OpcodeTable()
+        : ops_{}
+        , types_{}
+    {
+        const char hex[] = "0123456789abcdef";
+        for (unsigned i = 0; i < 256; ++i)
+        {
+            OpcodeInfo& op = ops_[i];
+            /* "<%x>" for anything not defined below */
+            const char wide[] = { '<', hex[i >> 4], hex[i & 15], '>', '\0' };
+            detail::copyName(op.name, i < 16 ? wide + 1 : wide);
+            op.name[0] = '<';
+            detail::copyName(op.pretty, "#ERR");
+            op.operand = OperandRule::None;
+            op.cls = OpClass::Invalid;
+        }
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            detail::copyName(types_[i].name, "???");
+            detail::copyName(types_[i].pretty, "???");
+            types_[i].operandSize = 4;
+        }
+
+        define(Operation::Nop,     "Nop",     nullptr,      OperandRule::None,  OpClass::Invalid);
+        define(Operation::Conv,    "Conv",    nullptr,      OperandRule::None,  OpClass::Convert);
+        define(Operation::Mul,     "Mul",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Div,     "Div",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Rem,     "Rem",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Mod,     "Mod",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Add,     "Add",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Sub,     "Sub",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::And,     "And",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Or,      "Or",      nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Xor,     "Xor",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Neg,     "Neg",     nullptr,      OperandRule::None,  OpClass::Unary);
+        define(Operation::Not,     "Not",     nullptr,      OperandRule::None,  OpClass::Unary);
+        define(Operation::Shl,     "Shl",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Shr,     "Shr",     nullptr,      OperandRule::None,  OpClass::Binary);
+        define(Operation::Cmp,     "Cmp",     nullptr,      OperandRule::None,  OpClass::Compare);
+        define(Operation::Set,     "Set",     nullptr,      OperandRule::Typed, OpClass::Store);
+        define(Operation::Dup,     "Dup",     nullptr,      OperandRule::None,  OpClass::Duplicate);
+        define(Operation::Ret,     "Ret",     nullptr,      OperandRule::None,  OpClass::Return);
+        define(Operation::Exit,    "Exit",    nullptr,      OperandRule::None,  OpClass::Exit);
+        define(Operation::Pop,     "Pop",     nullptr,      OperandRule::None,  OpClass::Drop);
+        define(Operation::Jmp,     "Jmp",     nullptr,      OperandRule::None,  OpClass::Jump);
+        define(Operation::JZ,      "JZ",      nullptr,      OperandRule::None,  OpClass::CondJump);
+        define(Operation::JNZ,     "JNZ",     nullptr,      OperandRule::None,  OpClass::CondJump);
+        define(Operation::PushEnv, "PushEnv", "push.env",   OperandRule::None,  OpClass::Env);
+        define(Operation::PopEnv,  "PopEnv",  "pop.env",    OperandRule::None,  OpClass::Env);
+        define(Operation::PushCst, "PushCst", "push.const", OperandRule::Typed, OpClass::Push);
+        define(Operation::PushLoc, "PushLoc", "push.local", OperandRule::Typed, OpClass::Push);
+        define(Operation::PushGlb, "PushGlb", "push.glob",  OperandRule::Typed, OpClass::Push);
+        define(Operation::PushVar, "PushVar", "push.var",   OperandRule::Typed, OpClass::Push);
+        define(Operation::PushI16, "PushI16", "push.int16", OperandRule::None,  OpClass::Push);
+        define(Operation::Call,    "Call",    nullptr,      OperandRule::Typed, OpClass::Call);
+        define(Operation::Break,   "Break",   nullptr,      OperandRule::None,  OpClass::Break);
+        define(Operation::Save,    "Save",    nullptr,      OperandRule::None,  OpClass::Save);
+
+        define(DataType::Double,   "Double",   nullptr, 8);
+        define(DataType::Float,    "Float",    nullptr, 4);
+        define(DataType::Int32,    "Int32",    nullptr, 4);
+        define(DataType::Int64,    "Int64",    nullptr, 8);
+        define(DataType::Bool,     "Bool",     nullptr, 4);
+        define(DataType::Variable, "Variable", "var",   4);
+        define(DataType::String,   "String",   nullptr, 4);
+        define(DataType::Instance, "Instance", nullptr, 4);
+        define(DataType::Int16,    "Int16",    nullptr, 0);
+    }
+
+    constexpr OpcodeInfo const& operator[](Operation op) const
+    {
+        return ops_[static_cast<unsigned>(op) & 0xff];
+    }
+
+    constexpr DataTypeInfo const& operator[](DataType t) const
+    {
+        return types_[static_cast<unsigned>(t) & 0x0f];
+    }
+
+private:
+    OpcodeInfo ops_[256];
+    DataTypeInfo types_[16];
+
+    constexpr void define(Operation op, const char* name, const char* pretty, OperandRule operand, OpClass cls)
+    {
+        OpcodeInfo& info = ops_[static_cast<unsigned>(op) & 0xff];
+        detail::copyName(info.name, name);
+        if (pretty)
+        {
+            detail::copyName(info.pretty, pretty);
+        }
+        else
+        {
+            detail::lowerName(info.pretty, name);
+        }
+        info.operand = operand;
+        info.cls = cls;
+    }
+
+    constexpr void define(DataType t, const char* name, const char* pretty, uint8_t operandSize)
+    {
+        DataTypeInfo& info = types_[static_cast<unsigned>(t) & 0x0f];
+        detail::copyName(info.name, name);
+        if (pretty)
+        {
+            detail::copyName(info.pretty, pretty);
+        }
+        else
+        {
+            detail::lowerName(info.pretty, name);
+        }
+        info.operandSize = operandSize;
+    }
+};
+
+extern const OpcodeTable Opcodes;
+
+
 std::vector<AsmCommand> Disassemble(BinaryReader& br, uint32_t pte);
 
 bool OperationIsPush(Operation op);
+bool OperationIsJump(Operation op);
 
 const char* Operation2String(Operation op);
-std::string Operation2PrettyString(Operation op);
+const char* Operation2PrettyString(Operation op);
 
 const char* Comparison2String(Comparison c);
 
 const char* DataType2String(DataType t);
-std::string DataType2PrettyString(DataType t);
+const char* DataType2PrettyString(DataType t);
 
+/* Immutable names, null for object indices */
 const char* InstanceType2String(InstanceType t);
-std::string InstanceType2PrettyString(InstanceType t);
+const char* InstanceType2PrettyString(InstanceType t);
+/* Pretty name, or the number of an object index */
+std::ostream& operator<< (std::ostream& out, InstanceType t);
 
 #endif // ASMCOMMAND_H
@@ -2,6 +2,8 @@
 #define BINARYREADER_H
 
 #include <vector>
+#include <string>
+#include <cstring>
 #include <ios>
 
 #include "utils.h"
@@ -11,6 +13,16 @@ class BinaryReader
 {
 public:
     BinaryReader(std::istream& is);
+    explicit BinaryReader(const std::string& path);
+    /* Independent cursor over the data of 'source', which must outlive it */
+    BinaryReader(const BinaryReader& source, int pos);
+    ~BinaryReader();
+
+    BinaryReader(const BinaryReader&) = delete;
+    BinaryReader& operator= (const BinaryReader&) = delete;
+
+    /* True if 'path' is a regular file that can be memory-mapped */
+    static bool IsMappable(const std::string& path);
 
     template<class T>
     typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value,
@@ -19,34 +31,71 @@ public:
     {
         using PT = typename std::decay<T>::type;
 
-        ASSERT(ptr_ + sizeof(T) <= buf_.size());
+        ASSERT(ptr_ + sizeof(T) <= size_);
         PT ret;
-        char* ptr = reinterpret_cast<char*>(&ret);
-        for (unsigned i = 0; i < sizeof(T); ++i) // little-endian
-        {
-            ptr[i] = buf_[ptr_++];
-        }
-        return ret;
+        std::memcpy(&ret, data_ + ptr_, sizeof(T));
+        ptr_ += sizeof(T);
+        return FromLittleEndian(ret);
     }
 
+    /* Bulk read: bounds are checked once for the whole run */
     template<class T>
     void read(typename std::remove_const<T>::type* o, int n)
     {
-        while (n--)
+        using PT = typename std::remove_const<T>::type;
+        static_assert(std::is_arithmetic<PT>::value || std::is_enum<PT>::value, "Only primitive arrays can be read in bulk");
+
+        if (n <= 0) { return; }
+
+        size_t bytes = sizeof(PT) * n;
+        ASSERT(ptr_ + bytes <= size_);
+        std::memcpy(o, data_ + ptr_, bytes);
+        ptr_ += bytes;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (int i = 0; i < n; ++i)
         {
-            *o++ = read<typename std::remove_const<T>::type>();
+            o[i] = FromLittleEndian(o[i]);
         }
+#endif
+    }
+
+    template<class T>
+    std::vector<T> readArray(int n)
+    {
+        std::vector<T> ret(n > 0 ? n : 0);
+        read<T>(ret.data(), n);
+        return ret;
     }
 
     int read(char* o, int n = -1);
     std::string readStringPtr();
+    std::string stringAt(uint32_t off) const;
+    /* Raw bytes at 'pos', valid while the underlying data lives */
+    const char* view(size_t pos, size_t n) const;
+    size_t size() const;
     void skip(int n);
     void seek(int p);
     int tell();
 
 private:
     std::vector<char> buf_;
+    const char* data_;
+    size_t size_;
     size_t ptr_;
+    void* mapping_;
+
+    void unmap();
+
+    template<class T>
+    static T FromLittleEndian(T v)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        char* p = reinterpret_cast<char*>(&v);
+        std::reverse(p, p + sizeof(T));
+#endif
+        return v;
+    }
 };
 
 
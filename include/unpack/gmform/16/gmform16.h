@@ -1,59 +1,72 @@
 #ifndef GMFORM16_H
 #define GMFORM16_H
 
+#include <memory>
+
 #include "gmform.h"
 
 
 class GmForm16 : public GmForm
 {
 public:
-    GmForm16(BinaryReader& br);
+    GmForm16(BinaryReader& br, std::string const& cachePath = std::string());
     virtual ~GmForm16();
 
     virtual int bytecodeVersion() const override { return 16; }
+    virtual void preload(int threads, bool withResources) override;
+
+    virtual GmStrgChunk const& strings()     const override { return load(strings_, SectionHeader::Strings); }
+    virtual GmCodeChunk const& code()        const override { return loadCode(); }
+    virtual GmSprtChunk const& sprites()     const override { return load(sprites_, SectionHeader::Sprites); }
+    virtual GmSondChunk const& sounds()      const override { return load(sounds_, SectionHeader::Sounds); }
+    virtual GmBgndChunk const& backgrounds() const override { return load(backgrounds_, SectionHeader::Backgrounds); }
+    virtual GmPathChunk const& paths()       const override { return load(paths_, SectionHeader::Paths); }
+    virtual GmScptChunk const& scripts()     const override { return load(scripts_, SectionHeader::Scripts); }
+    virtual GmShdrChunk const& shaders()     const override { return load(shaders_, SectionHeader::Shaders); }
+    virtual GmFontChunk const& fonts()       const override { return load(fonts_, SectionHeader::Fonts); }
+    virtual GmTmlnChunk const& timelines()   const override { return load(timelines_, SectionHeader::Timelines); }
+    virtual GmObjtChunk const& objects()     const override { return load(objects_, SectionHeader::Objects); }
+    virtual GmRoomChunk const& rooms()       const override { return load(rooms_, SectionHeader::Rooms); }
+    virtual GmFuncChunk const& functions()   const override { return load(functions_, SectionHeader::Functions); }
+    virtual GmVariChunk const& variables()   const override { return load(variables_, SectionHeader::Variables); }
 
-    virtual GmStrgChunk const& strings()     const override { return strings_; }
-    virtual GmCodeChunk const& code()        const override { return code_; }
-    virtual GmSprtChunk const& sprites()     const override { return sprites_; }
-    virtual GmSondChunk const& sounds()      const override { return sounds_; }
-    virtual GmBgndChunk const& backgrounds() const override { return backgrounds_; }
-    virtual GmPathChunk const& paths()       const override { return paths_; }
-    virtual GmScptChunk const& scripts()     const override { return scripts_; }
-    virtual GmShdrChunk const& shaders()     const override { return shaders_; }
-    virtual GmFontChunk const& fonts()       const override { return fonts_; }
-    virtual GmTmlnChunk const& timelines()   const override { return timelines_; }
-    virtual GmObjtChunk const& objects()     const override { return objects_; }
-    virtual GmRoomChunk const& rooms()       const override { return rooms_; }
-
-    virtual GmCodeChunk& code() override { return code_; }
+    virtual GmCodeChunk& code() override { return loadCode(); }
 
 private:
+    BinaryReader& br_;
     GmHeader header_;
+    GmChunkDirectory directory_;
+    std::string cachePath_;
+
+    /* Chunks are parsed on first access */
+    mutable std::unique_ptr<GmSondChunk> sounds_;
+    mutable std::unique_ptr<GmSprtChunk> sprites_;
+    mutable std::unique_ptr<GmBgndChunk> backgrounds_;
+    mutable std::unique_ptr<GmPathChunk> paths_;
+    mutable std::unique_ptr<GmScptChunk> scripts_;
+    mutable std::unique_ptr<GmShdrChunk> shaders_;
+    mutable std::unique_ptr<GmFontChunk> fonts_;
+    mutable std::unique_ptr<GmTmlnChunk> timelines_;
+    mutable std::unique_ptr<GmObjtChunk> objects_;
+    mutable std::unique_ptr<GmRoomChunk> rooms_;
+    mutable std::unique_ptr<GmCodeChunk> code_;
+    mutable std::unique_ptr<GmVariChunk> variables_;
+    mutable std::unique_ptr<GmFuncChunk> functions_;
+    mutable std::unique_ptr<GmStrgChunk> strings_;
+    mutable bool codeReady_;
+
+    GmCodeChunk& loadCode() const;
 
-    GmGen8Chunk general_;
-    GmOptnChunk options_;
-    GmLangChunk language_;
-    GmExtnChunk extensions_;
-    GmSondChunk sounds_;
-    GmAgrpChunk audioGroup_;
-    GmSprtChunk sprites_;
-    GmBgndChunk backgrounds_;
-    GmPathChunk paths_;
-    GmScptChunk scripts_;
-    GmGlobChunk globals_;
-    GmShdrChunk shaders_;
-    GmFontChunk fonts_;
-    GmTmlnChunk timelines_;
-    GmObjtChunk objects_;
-    GmRoomChunk rooms_;
-    GmDaflChunk datafiles_;
-    GmTpagChunk texturePages_;
-    GmCodeChunk code_;
-    GmVariChunk variables_;
-    GmFuncChunk functions_;
-    GmStrgChunk strings_;
-    GmTxtrChunk textures_;
-    GmAudoChunk audio_;
+    template<class Chunk>
+    Chunk& load(std::unique_ptr<Chunk>& slot, SectionHeader hdr) const
+    {
+        if (!slot)
+        {
+            BinaryReader cursor(br_, directory_.at(hdr).start);
+            slot = std::make_unique<Chunk>(cursor);
+        }
+        return *slot;
+    }
 };
 
 #endif // GMFORM16_H
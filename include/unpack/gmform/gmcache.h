@@ -0,0 +1,52 @@
+#ifndef GMCACHE_H
+#define GMCACHE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmchunk.h"
+#include "binaryreader.h"
+
+
+/* On-disk copy of the decoded CODE chunk: resolved FUNC/VARI references
+ * and disassembled scripts. The file is mapped and instructions are
+ * copied out of it as scripts are accessed. */
+class GmCache
+{
+public:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t key;
+        uint32_t scriptCount;
+        uint32_t symbolCount;
+        uint32_t commandCount;
+        uint32_t reserved;
+    };
+
+    /* Hash of the chunks the cache is derived from */
+    static uint64_t Key(BinaryReader const& br, GmChunkDirectory const& dir);
+
+    /* Null if the file is missing, unreadable or made for another input */
+    static std::shared_ptr<const GmCache> Open(std::string const& path, uint64_t key);
+    static void Write(std::string const& path, uint64_t key, GmCodeChunk const& code);
+
+    int scriptCount() const;
+    GmCodeChunk::symbol_refs_t symbols() const;
+    std::vector<AsmCommand> commands(int script) const;
+
+    explicit GmCache(std::string const& path);
+
+private:
+    BinaryReader file_;
+    Header header_;
+
+    size_t scriptsPos() const;
+    size_t symbolsPos() const;
+    size_t commandsPos() const;
+};
+
+#endif // GMCACHE_H
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "gmheader.h"
 #include "utils.h"
@@ -13,6 +14,7 @@
 
 
 class GmForm;
+class GmCache;
 class BinaryReader;
 
 /* ****** *
@@ -48,8 +50,7 @@ struct GmPointerList
     {
         uint32_t n = br.read<uint32_t>();
 
-        uint32_t pointers[n];
-        br.read<uint32_t>(pointers, n);
+        std::vector<uint32_t> pointers = br.readArray<uint32_t>(n);
 
         content.reserve(n);
 
@@ -142,20 +143,32 @@ struct ScriptDefEntry
     explicit ScriptDefEntry(BinaryReader& br);
 };
 
+struct GmCodeChunk;
+
 struct ScriptEntry
 {
     using v_code_t = std::vector<AsmCommand>;
 
     std::string name;
-    v_code_t code;
     uint32_t offset, codeOffset, codeSize;
 
     explicit ScriptEntry(BinaryReader& br);
 
-    auto begin() { return code.begin(); }
-    auto end()   { return code.end(); }
+    /* Bytecode is disassembled on first access */
+    v_code_t const& code() const;
+
+    auto begin() const { return code().begin(); }
+    auto end()   const { return code().end(); }
+
+    void print(std::ostream& out, GmForm const& f) const;
 
-    friend std::ostream& operator<< (std::ostream&, ScriptEntry const&);
+private:
+    friend struct GmCodeChunk;
+
+    const GmCodeChunk* owner_;
+    int index_;
+    mutable v_code_t code_;
+    mutable bool decoded_;
 };
 
 struct GlobalvarEntry
@@ -232,7 +245,7 @@ struct FunctionDefEntry
     uint32_t occurrenceCount;
     uint32_t firstOccurrence;
 
-    explicit FunctionDefEntry(BinaryReader& br);
+    FunctionDefEntry(const BinaryReader& br, const uint32_t* raw);
 };
 
 struct FontEntry
@@ -250,7 +263,7 @@ struct VariableDefEntry
     int32_t occurrenceCount;
     int32_t firstOccurrence;
 
-    explicit VariableDefEntry(BinaryReader& br);
+    VariableDefEntry(const BinaryReader& br, const uint32_t* raw);
 };
 
 struct LocalVariableDefEntry
@@ -260,7 +273,7 @@ struct LocalVariableDefEntry
     VariableType type;
     std::string name;
 
-    explicit LocalVariableDefEntry(BinaryReader& br);
+    LocalVariableDefEntry(const BinaryReader& br, const uint32_t* raw);
 };
 
 struct LocalScriptDefEntry
@@ -395,17 +408,31 @@ struct GmTpagChunk : GmListChunk<TextureEntry>
 
 struct GmCodeChunk : GmListChunk<ScriptEntry>
 {
-    AsmCommand* at(int off);
-    void postInit(GmForm& f);
+    using symbol_refs_t = std::vector<std::pair<int, uint32_t>>;
 
     explicit GmCodeChunk(BinaryReader& br);
+
+    /* Decodes a single instruction in place, scripts stay untouched */
+    bool peek(int addr, AsmCommand& out) const;
+    /* FUNC/VARI indices applied to instructions as scripts get disassembled */
+    void bindSymbols(symbol_refs_t const& refs);
+    symbol_refs_t const& symbols() const { return symbols_; }
+    /* Takes resolved references and instructions from a matching cache */
+    void restore(std::shared_ptr<const GmCache> cache);
+    void disassemble(ScriptEntry const& scr) const;
+
+private:
+    BinaryReader reader_;
+    int codeBegin_, codeEnd_;
+    symbol_refs_t symbols_;
+    std::shared_ptr<const GmCache> cache_;
 };
 
 struct GmVariChunk : GmChunk
 {
     std::vector<VariableDefEntry> refVar;
 
-    void postInit(GmForm& f);
+    void postInit(GmCodeChunk& code);
 
     explicit GmVariChunk(BinaryReader& br);
 };
@@ -415,7 +442,7 @@ struct GmFuncChunk : GmChunk
     std::vector<FunctionDefEntry> refFunc;
     std::vector<LocalScriptDefEntry> refScript;
 
-    void postInit(GmForm& f);
+    void postInit(GmCodeChunk& code);
 
     explicit GmFuncChunk(BinaryReader& br);
 };
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <vector>
+#include <memory>
 
 #include "gmheader.h"
 #include "gmchunk.h"
@@ -14,11 +15,17 @@ class GmForm
 public:
     using ptr_t = std::unique_ptr<GmForm>;
 
-    static ptr_t Read(BinaryReader& br);
+    /* Decoded code is taken from 'cachePath' when it was made for the same
+     * input, otherwise the cache is rebuilt. Empty path disables caching. */
+    static ptr_t Read(BinaryReader& br, std::string const& cachePath = std::string());
 
     virtual ~GmForm() {};
     virtual int bytecodeVersion() const = 0;
 
+    /* Parse chunks ahead of first access using 'threads' workers (0 - all cores).
+     * Only chunks needed for code are parsed unless 'withResources' is set. */
+    virtual void preload(int threads, bool withResources) = 0;
+
     virtual GmCodeChunk const& code() const = 0;
     virtual GmStrgChunk const& strings() const = 0;
     virtual GmSprtChunk const& sprites() const = 0;
@@ -31,8 +38,13 @@ public:
     virtual GmTmlnChunk const& timelines() const = 0;
     virtual GmObjtChunk const& objects() const = 0;
     virtual GmRoomChunk const& rooms() const = 0;
+    virtual GmFuncChunk const& functions() const = 0;
+    virtual GmVariChunk const& variables() const = 0;
 
     virtual GmCodeChunk& code() = 0;
+
+    /* Name of the function or variable referred by Call, Push or Set */
+    std::string const& symbolName(AsmCommand const& cmd) const;
 };
 
 #endif // GMFORM_H
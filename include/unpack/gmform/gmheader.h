@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <string>
+#include <map>
 
 #include "utils.h"
 
@@ -46,4 +47,24 @@ struct GmHeader
     GmHeader(BinaryReader& br);
 };
 
+
+/* Offsets of all chunks inside FORM, collected in a single pass over headers */
+class GmChunkDirectory
+{
+public:
+    struct Entry
+    {
+        int start;
+        int size;
+    };
+
+    GmChunkDirectory(BinaryReader& br, GmHeader const& form);
+
+    bool contains(SectionHeader hdr) const;
+    Entry const& at(SectionHeader hdr) const;
+
+private:
+    std::map<SectionHeader, Entry> entries_;
+};
+
 #endif // GMHEADER_H
@@ -4,6 +4,7 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <iosfwd>
 
 class ExprContext
 {
@@ -85,7 +86,9 @@ public:
         return ret == argContext_.end() ? nullptr : &ret->second;
     }
 
-    static const char* ValueInContext(int val, Type ctx);
+    /* Writes the constant, or the flags, naming 'val'. Nothing is written
+     * if there is no name for it. */
+    static bool WriteValueInContext(std::ostream& out, int val, Type ctx);
 
 private:
     ExprContext() = delete;
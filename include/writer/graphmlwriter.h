@@ -5,21 +5,27 @@
 #include <string>
 
 #include "flowgraph.h"
+#include "steptrace.h"
 #include "indentablewriter.h"
 
 class GmAST;
 class ControlTree;
+class GmForm;
 
 class GraphmlWriter : public IndentableWriter
 {
 public:
-    GraphmlWriter(std::ostream& os);
+    GraphmlWriter(std::ostream& os, const GmForm* f = nullptr);
 
     void print(const GmAST& ast);
     void print(const FlowGraph& g);
     void print(const ControlTree& t);
+    void print(const StepTraceReader::graph_t& g);
 
 private:
+    const GmForm* form_;
+
+    std::string label(const ControlTree& t);
     void print_impl(const GmAST& ast);
     void print_impl(const ControlTree& t);
     void print_node(const FlowGraph::Node& n);
@@ -1,8 +1,10 @@
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "gmform.h"
 #include "utils.h"
@@ -11,6 +13,9 @@
 #include "algext.h"
 #include "binaryreader.h"
 #include "gmxproject.h"
+#include "graphmlwriter.h"
+#include "steptrace.h"
+#include "manifest.h"
 
 
 struct Options
@@ -18,9 +23,16 @@ struct Options
     std::string dataWin = "data.win";
     std::string outputDir = "out";
     std::string logSubdir = "_log";
+    std::string cacheFile;
+    std::string replayTrace;
+    std::string manifest;
     std::vector<std::string> targets;
     std::vector<std::string> ignore;
     bool verboseLog = false;
+    bool printStats = false;
+    int maxSteps = 0;
+    int timeLimitMs = 0;
+    int threads = 1;
 
     std::string logFullPath() const { return outputDir + "/" + logSubdir; }
 };
@@ -34,7 +46,15 @@ void printUsage()
               " -e \"<script1>[,script2...]\" - Exclude scripts\n"
               " -f <file>   - Your 'data.win' file. (default './data.win')\n"
               " -o <dir>    - Output folder. (default './out')\n"
+              " -c <file>   - Decoded form cache, reused while 'data.win' is unchanged.\n"
               " -v          - Verbose log.\n"
+              " -s          - Print pattern matcher statistics.\n"
+              " -b <ms>     - Time budget per script, raw blocks are written past it.\n"
+              " -n <steps>  - Reduction step budget per script.\n"
+              " -j <n>      - Scripts decompiled in parallel, 0 for one per core. (default 1)\n"
+              " -r <trace>[:step] - Print a step of a 'fold_trace.bin' as GraphML, or list its steps.\n"
+              " -m <file>   - Script hashes of the previous run into the same folder: only changed\n"
+              "               scripts are written, other files are left alone. Updated after the run.\n"
               ;
 }
 
@@ -85,12 +105,84 @@ Options parse_commandline(int argc, char** argv)
             ret.outputDir = argv[i + 1];
             i += 2;
 
+        }
+		else if (!strcmp(argv[i], "-c"))
+		{
+            if (i == argc - 1)
+			{
+                printUsage();
+                break;
+            }
+            ret.cacheFile = argv[i + 1];
+            i += 2;
+
         }
 		else if (!strcmp(argv[i], "-v"))
 		{
             ret.verboseLog = true;
             ++i;
 
+        }
+		else if (!strcmp(argv[i], "-s"))
+		{
+            ret.printStats = true;
+            ++i;
+
+        }
+		else if (!strcmp(argv[i], "-b"))
+		{
+            if (i == argc - 1)
+			{
+                printUsage();
+                break;
+            }
+            ret.timeLimitMs = atoi(argv[i + 1]);
+            i += 2;
+
+        }
+		else if (!strcmp(argv[i], "-n"))
+		{
+            if (i == argc - 1)
+			{
+                printUsage();
+                break;
+            }
+            ret.maxSteps = atoi(argv[i + 1]);
+            i += 2;
+
+        }
+		else if (!strcmp(argv[i], "-j"))
+		{
+            if (i == argc - 1)
+			{
+                printUsage();
+                break;
+            }
+            ret.threads = atoi(argv[i + 1]);
+            i += 2;
+
+        }
+		else if (!strcmp(argv[i], "-r"))
+		{
+            if (i == argc - 1)
+			{
+                printUsage();
+                break;
+            }
+            ret.replayTrace = argv[i + 1];
+            i += 2;
+
+        }
+		else if (!strcmp(argv[i], "-m"))
+		{
+            if (i == argc - 1)
+			{
+                printUsage();
+                break;
+            }
+            ret.manifest = argv[i + 1];
+            i += 2;
+
         }
 		else if (!strcmp(argv[i], "-t"))
 		{
@@ -124,23 +216,79 @@ Options parse_commandline(int argc, char** argv)
     return ret;
 }
 
+int replayTrace(std::string const& arg)
+{
+    std::string path = arg;
+    int step = -1;
+    size_t colon = arg.rfind(':');
+    if (colon != std::string::npos && colon + 1 < arg.size()
+        && arg.find_first_not_of("0123456789", colon + 1) == std::string::npos)
+	{
+        path = arg.substr(0, colon);
+        step = atoi(arg.c_str() + colon + 1);
+    }
+
+    StepTraceReader trace(path);
+    if (step < 0)
+	{
+        for (int i = 0; i < trace.steps(); ++i)
+		{
+            int p = trace.pattern(i);
+            std::cout << std::setw(6) << i << "  "
+                      << (p == StepTraceReader::NoPattern ? "-" : FlowGraph::PatternName(static_cast<FlowGraph::Pattern>(p)))
+                      << "\n";
+        }
+        return 0;
+    }
+    if (step >= trace.steps())
+	{
+        std::cerr << path << " has " << trace.steps() << " steps\n";
+        return 1;
+    }
+
+    GraphmlWriter(std::cout).print(trace.graph(step));
+    return 0;
+}
+
 
 int main(int argc, char** argv)
 {
     Options opt = parse_commandline(argc, argv);
     std::wstring wout = wide(opt.outputDir);
 
-    std::ifstream dump(opt.dataWin, std::ios::binary);
-    FsManager::directoryDelete(wout);
+    if (!opt.replayTrace.empty())
+	{
+        return replayTrace(opt.replayTrace);
+    }
+
+    /* With a manifest, files of unchanged scripts are kept */
+    if (opt.manifest.empty())
+	{
+        FsManager::directoryDelete(wout);
+    }
     FsManager::directoryCreate(wout);
 
     std::clog << "Loading " << opt.dataWin << "...\n";
-    BinaryReader br(dump);
-    auto f = GmForm::Read(br);
+    std::unique_ptr<BinaryReader> br;
+    if (BinaryReader::IsMappable(opt.dataWin))
+    {
+        br = std::make_unique<BinaryReader>(opt.dataWin);
+    }
+    else
+    {
+        std::ifstream dump(opt.dataWin, std::ios::binary);
+        br = std::make_unique<BinaryReader>(dump);
+    }
+    auto f = GmForm::Read(*br, opt.cacheFile);
+    f->preload(0, opt.targets.empty());
 
     Decompiler::Options dcOptn = Decompiler::Options::Debug();
     dcOptn.outputDir = opt.logFullPath();
     dcOptn.logFlowgraph = dcOptn.logTree = dcOptn.logAssembly = opt.verboseLog;
+    dcOptn.logStats = opt.printStats;
+    dcOptn.maxSteps = opt.maxSteps;
+    dcOptn.timeLimitMs = opt.timeLimitMs;
+    dcOptn.threads = opt.threads;
     dcOptn.decompileAll = opt.targets.empty();
     std::copy(opt.targets, std::inserter(dcOptn.targets, dcOptn.targets.end()));
     std::copy(opt.ignore, std::inserter(dcOptn.ignore, dcOptn.ignore.end()));
@@ -148,9 +296,31 @@ int main(int argc, char** argv)
     Decompiler dc(*f);
     dc.options = dcOptn;
 
+    Manifest previous, current;
+    if (!opt.manifest.empty())
+	{
+        previous = Manifest::Read(opt.manifest);
+        dc.options.previous = &previous;
+    }
+
     GmxProject p;
-    dc.decompile(p);
+    p.options.threads = opt.threads;
+    dc.decompile(p, opt.manifest.empty() ? nullptr : &current);
+
+    /* Changed scripts are rewritten, removed ones deleted */
+    for (auto const& kv : previous.scripts())
+	{
+        if (!current.contains(kv.first, kv.second))
+		{
+            p.dropCode(kv.first);
+        }
+    }
 
     p.analyzeContexts();
     p.exportGmx(*f, opt.outputDir);
+
+    if (!opt.manifest.empty())
+	{
+        current.write(opt.manifest);
+    }
 }
@@ -8,37 +8,39 @@
 
 
 BaseBlock::BaseBlock()
-    : code_()
+    : first_(nullptr)
+    , last_(nullptr)
 {}
 
-BaseBlock::BaseBlock(const std::vector<AsmCommand>& p)
-    : code_(p)
+BaseBlock::BaseBlock(const AsmCommand* first, const AsmCommand* last)
+    : first_(first)
+    , last_(last)
 {}
 
 int BaseBlock::addr() const
 {
-    return code_.front().addr;
+    return first_[0].addr;
 }
 
 int BaseBlock::pastTheEndAddr() const
 {
-    const auto& c = code_.back();
-    return c.addr + c.size;
+    const auto& c = back();
+    return c.addr + c.size();
 }
 
 bool BaseBlock::hasJumpIfTrue() const
 {
-    return code_.back().operation() == Operation::JNZ;
+    return back().operation() == Operation::JNZ;
 }
 
 bool BaseBlock::hasJumpIfFalse() const
 {
-    return code_.back().operation() == Operation::JZ;
+    return back().operation() == Operation::JZ;
 }
 
 bool BaseBlock::hasJumpAlways() const
 {
-    return code_.back().operation() == Operation::Jmp;
+    return back().operation() == Operation::Jmp;
 }
 
 bool BaseBlock::hasJumpIf() const
@@ -57,56 +59,66 @@ int BaseBlock::jumpTargetAddr() const
 	{
         throw std::runtime_error("Trying to get jump target of BB that has no jump");
     }
-    return code_.back().jumpAddr();
+    return back().jumpAddr();
 }
 
 bool BaseBlock::isNumber() const
 {
-    return code_.size() == 1
-           && OperationIsPush(code_[0].operation());
+    return size() == 1
+           && OperationIsPush(first_[0].operation());
 }
 
 bool BaseBlock::isNumber(int x) const
 {
     return isNumber()
-           && code_[0].dataInt16() == x;
+           && first_[0].dataInt16() == x;
 }
 
 bool BaseBlock::endsAsSwitchHeader() const
 {
-    return code_.size() > 4
+    return size() > 4
            && endsAsSwitchCase();
 }
 
 bool BaseBlock::endsAsSwitchCase() const
 {
-    size_t n = code_.size();
+    size_t n = size();
     return n >= 4
-           && code_[n - 2].operation() == Operation::Cmp
-           && code_[n - 2].cmpType() == Comparison::EQ
-           && OperationIsPush(code_[n - 3].operation())
-           && code_[n - 4].operation() == Operation::Dup;
+           && first_[n - 2].operation() == Operation::Cmp
+           && first_[n - 2].cmpType() == Comparison::EQ
+           && OperationIsPush(first_[n - 3].operation())
+           && first_[n - 4].operation() == Operation::Dup;
 }
 
 bool BaseBlock::endsWithExit() const
 {
-    return !code_.empty()
-           && code_.back().operation() == Operation::Exit;
+    return first_ != last_
+           && back().operation() == Operation::Exit;
 }
 
 bool BaseBlock::startsWithPop() const
 {
-    return !code_.empty()
-           && code_[0].operation() == Operation::Pop;
+    return first_ != last_
+           && first_[0].operation() == Operation::Pop;
 }
 
 bool BaseBlock::isNop() const
 {
-    return code_.empty()
-           || (code_.size() == 1 && hasJump());
+    return first_ == last_
+           || (size() == 1 && hasJump());
 }
 
 bool BaseBlock::valid() const
 {
-    return !code_.empty();
+    return first_ != last_;
+}
+
+size_t BaseBlock::size() const
+{
+    return last_ - first_;
+}
+
+const AsmCommand& BaseBlock::back() const
+{
+    return last_[-1];
 }
@@ -157,39 +157,39 @@ const char* ControlTreeTypeToString(ControlTree::Type t)
     return "<Type>";
 }
 
-std::ostream& operator<< (std::ostream& out, const ControlTree& t)
+void ControlTree::print(std::ostream& out, const GmForm* f, int depth) const
 {
-    static int depth = 0;
-
     std::string pad;
     for (int i = 0; i < depth; ++i)
 	{
         pad += "    ";
     }
 
-    out << pad << ControlTreeTypeToString(t.type_) << " {" << std::endl;
+    out << pad << ControlTreeTypeToString(type_) << " {" << std::endl;
 
-    ++depth;
-    for (const auto& ptr : t.leaves_)
+    for (const auto& ptr : leaves_)
 	{
-        out << *ptr << std::endl;
+        ptr->print(out, f, depth + 1);
+        out << std::endl;
     }
-    if (t.type_ == ControlTree::Type::Terminal)
+    if (type_ == Type::Terminal)
 	{
         std::string pad2(pad);
         pad2 += "    ";
-        std::string bs;
-        {
-            std::ostringstream os;
-            for (auto& cmd : t.bb_)
+        for (auto& cmd : bb_)
+		{
+            out << pad2;
+            if (f)
+			{
+                cmd.print(out, *f);
+            }
+			else
 			{
-                os << pad2 << cmd.toString() << std::endl;
+                out << cmd.addr;
             }
-            bs = os.str();
+            out << std::endl;
         }
-        out << bs;
     }
-    --depth;
 
-    return out << pad << "}";
+    out << pad << "}";
 }
@@ -1,7 +1,12 @@
 #include "decompiler.h"
 
 #include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
 #include <cassert>
+#include <chrono>
+#include <unordered_map>
 
 #include "gmform.h"
 #include "gmchunk.h"
@@ -14,6 +19,8 @@
 #include "gmlwriter.h"
 #include "asttransformer.h"
 #include "gmxproject.h"
+#include "scheduler.h"
+#include "manifest.h"
 
 const std::map<Operation, std::string> Decompiler::AsmOpToBinary{
     { Operation::Add, "+" },
@@ -53,6 +60,21 @@ const std::map<Comparison, std::string> Decompiler::ComparisonToOperator{
 };
 
 
+namespace
+{
+    void addStats(FlowGraph::stats_t& to, FlowGraph::stats_t const& from)
+    {
+        for (size_t i = 0; i < to.size(); ++i)
+        {
+            to[i].hits += from[i].hits;
+            to[i].misses += from[i].misses;
+            to[i].probeHits += from[i].probeHits;
+            to[i].probeMisses += from[i].probeMisses;
+        }
+    }
+}
+
+
 Decompiler::Options Decompiler::Options::Debug()
 {
     Options ret;
@@ -60,7 +82,13 @@ Decompiler::Options Decompiler::Options::Debug()
     ret.logFlowgraph = true;
     ret.logTree = true;
     ret.logAssembly = true;
+    ret.logStats = true;
     ret.decompileAll = true;
+    ret.maxSteps = 0;
+    ret.timeLimitMs = 0;
+    ret.threads = 1;
+    ret.dedup = true;
+    ret.previous = nullptr;
     return ret;
 }
 
@@ -71,7 +99,13 @@ Decompiler::Options Decompiler::Options::Release()
     ret.logFlowgraph = false;
     ret.logTree = false;
     ret.logAssembly = false;
+    ret.logStats = false;
     ret.decompileAll = true;
+    ret.maxSteps = 0;
+    ret.timeLimitMs = 0;
+    ret.threads = 1;
+    ret.dedup = true;
+    ret.previous = nullptr;
     return ret;
 }
 
@@ -82,37 +116,352 @@ Decompiler::Decompiler(GmForm& f)
     , addr_(nullptr)
     , index_(nullptr)
     , ret_expr_(nullptr)
+    , stats_()
+    , fallbacks_()
+    , log_(&std::cout)
+    , fallback_(false)
 {}
 
-void Decompiler::decompile(GmxProject& proj)
+void Decompiler::decompile(GmxProject& proj, Manifest* manifest)
 {
     if (options.logAnything())
     {
         FsManager::directoryCreate(std::wstring(options.outputDir.begin(), options.outputDir.end()));
     }
 
-    for (ScriptEntry const& src : form_->code())
+    GmCodeChunk const& code = form_->code();
+    std::vector<Result> results(code.count());
+
+    /* Logs are written per script, so logging turns grouping off */
+    const bool dedup = options.dedup && !options.logAnything();
+    /* Listed hashes also cover the resource names output refers to */
+    const bool listing = manifest || options.previous;
+    const uint64_t resources = listing ? Manifest::Key(*form_, options) : 0;
+
+    std::vector<uint64_t> hashes((dedup || listing) ? code.count() : 0, 0);
+    std::vector<int> same(code.count());
+    std::vector<char> kept(code.count(), 0), shared(code.count(), 0);
+    /* Decompiled in full: raw blocks and failures are retried next time */
+    std::vector<char> complete(code.count(), 0);
+    auto hash = [&](int n)
+	{
+        if (!hashes.empty() && (listing || !skipped(code[n])))
+		{
+            const std::string key = bodyKey(code[n]);
+            hashes[n] = hash_bytes(key.data(), key.size());
+        }
+    };
+    auto listed = [&](int n)
+	{
+        return hash_bytes(&resources, sizeof(resources), hashes[n]);
+    };
+    auto group = [&]()
+	{
+        for (int n = 0; n < code.count(); ++n)
+		{
+            kept[n] = options.previous && options.previous->contains(code[n].name, listed(n));
+            same[n] = n;
+        }
+        if (dedup)
+		{
+            same = groupBodies(hashes, kept);
+        }
+        for (int n = 0; n < code.count(); ++n)
+		{
+            if (same[n] != n)
+			{
+                shared[same[n]] = 1;
+            }
+        }
+    };
+
+    if (options.threads == 1)
+	{
+        for (int n = 0; n < code.count(); ++n)
+		{
+            hash(n);
+        }
+        group();
+
+        for (int n = 0; n < code.count(); ++n)
+		{
+            if (kept[n])
+			{
+                continue;
+            }
+            results[n] = same[n] == n
+                ? decompileEntry(code[n], std::cout)
+                : duplicate(code[n], code[same[n]], results[same[n]]);
+            complete[n] = results[n].tree && !results[n].fallback;
+            report(code[n], results[n], proj, shared[n]);
+        }
+    }
+	else
+	{
+        /* Scripts are independent: each worker has its own context and
+         * results are reported in code order once all are done. Workers
+         * share the form and its chunks are parsed on first access, so
+         * the ones they read are loaded up front */
+        form_->preload(options.threads, false);
+
+        Scheduler sched(options.threads);
+        std::vector<std::unique_ptr<Decompiler>> workers(sched.size());
+
+        /* Decoding comes first anyway and tells the jump count */
+        std::vector<uint64_t> sizes(code.count()), costs(code.count());
+        for (int n = 0; n < code.count(); ++n)
+		{
+            sizes[n] = code[n].codeSize;
+        }
+        sched.run(sizes, [&](int, int n)
+		{
+            costs[n] = skipped(code[n]) ? 1 : EstimateCost(code[n]);
+            hash(n);
+        });
+        group();
+        for (int n = 0; n < code.count(); ++n)
+		{
+            if (kept[n] || same[n] != n)
+			{
+                costs[n] = 1;
+            }
+        }
+
+        sched.run(costs, [&](int w, int n)
+		{
+            if (kept[n] || same[n] != n)
+			{
+                return;
+            }
+            if (!workers[w])
+			{
+                workers[w] = std::make_unique<Decompiler>(*form_);
+                workers[w]->options = options;
+            }
+            std::ostringstream log;
+            results[n] = workers[w]->decompileEntry(code[n], log);
+            results[n].log = log.str();
+        });
+
+        for (int n = 0; n < code.count(); ++n)
+		{
+            if (kept[n])
+			{
+                continue;
+            }
+            if (same[n] != n)
+			{
+                results[n] = duplicate(code[n], code[same[n]], results[same[n]]);
+            }
+            complete[n] = results[n].tree && !results[n].fallback;
+            report(code[n], results[n], proj, shared[n]);
+        }
+        for (auto& worker : workers)
+		{
+            if (worker)
+			{
+                addStats(stats_, worker->stats_);
+            }
+        }
+        printUtilisation(sched);
+    }
+
+    int copies = 0, unchanged = 0;
+    for (int n = 0; n < code.count(); ++n)
+	{
+        copies += same[n] != n;
+        unchanged += kept[n];
+        if (manifest && (kept[n] || complete[n]))
+		{
+            manifest->add(code[n].name, listed(n));
+        }
+    }
+    if (options.previous)
+	{
+        std::cout << "Unchanged: " << unchanged << " of " << code.count() << " scripts kept\n";
+    }
+    if (copies)
+	{
+        const int distinct = code.count() - copies;
+        std::cout << "Identical code: " << code.count() << " scripts, " << distinct
+                  << " distinct, dedup ratio " << std::fixed << std::setprecision(2)
+                  << static_cast<double>(code.count()) / distinct << "\n";
+    }
+
+    if (!fallbacks_.empty())
+	{
+        std::cout << "Budget exceeded, raw blocks written for " << fallbacks_.size() << " scripts:\n";
+        for (std::string const& name : fallbacks_)
+		{
+            std::cout << "  " << name << "\n";
+        }
+    }
+
+    if (options.logStats)
+	{
+        printStats();
+    }
+}
+
+uint64_t Decompiler::EstimateCost(ScriptEntry const& src)
+{
+    /* Reduction work grows with the number of blocks, and each block is
+     * rescanned as the graph around it folds */
+    uint64_t jumps = 0;
+    for (AsmCommand const& cmd : src)
 	{
-        auto tgt_it = options.targets.find(src.name);
-        auto ign_it = options.ignore.find(src.name);
-        if ((!options.decompileAll && tgt_it == options.targets.end()) || ign_it != options.ignore.end())
+        if (OperationIsJump(cmd.operation()))
+		{
+            ++jumps;
+        }
+    }
+    return src.code().size() + jumps * jumps;
+}
+
+bool Decompiler::skipped(ScriptEntry const& src) const
+{
+    return (!options.decompileAll && !options.targets.count(src.name)) || options.ignore.count(src.name);
+}
+
+std::string Decompiler::bodyKey(ScriptEntry const& src) const
+{
+    std::string key;
+    auto put = [&key](const void* p, size_t n)
+	{
+        key.append(static_cast<const char*>(p), n);
+    };
+    auto putString = [&put](std::string const& s)
+	{
+        uint32_t n = s.size();
+        put(&n, sizeof(n));
+        put(s.data(), n);
+    };
+
+    for (AsmCommand const& cmd : src)
+	{
+        /* Opcode, types, instance and jump offsets, which are relative */
+        put(&cmd.data, sizeof(cmd.data));
+
+        const int words = cmd.size() / 4 - 1;
+        if (cmd.hasSymbol())
+		{
+            /* The index word also chains occurrences; only the kind of
+             * variable reference is kept */
+            uint8_t kind = cmd.operation() == Operation::Call ? 0 : cmd.extra[0] >> 24;
+            put(&kind, sizeof(kind));
+            putString(form_->symbolName(cmd));
+        }
+		else if (OperationIsPush(cmd.operation()) && cmd.dataType() == DataType::String && words > 0)
+		{
+            putString(form_->strings().get(cmd.dataInt32()));
+        }
+		else
+		{
+            put(cmd.extra, words * sizeof(cmd.extra[0]));
+        }
+    }
+    return key;
+}
+
+std::vector<int> Decompiler::groupBodies(std::vector<uint64_t> const& hashes, std::vector<char> const& kept) const
+{
+    GmCodeChunk const& code = form_->code();
+    std::vector<int> same(code.count());
+    std::unordered_map<uint64_t, std::vector<int>> firsts;
+
+    for (int n = 0; n < code.count(); ++n)
+	{
+        same[n] = n;
+        if (kept[n] || skipped(code[n]))
 		{
-            std::cout << "Skipped: " << src.name << std::endl;
             continue;
         }
 
-        std::cout << "Processing: " << src.name << std::endl;
+        /* Hashes only pick the candidates, bodies are compared in full */
+        std::vector<int>& candidates = firsts[hashes[n]];
+        if (!candidates.empty())
+		{
+            const std::string key = bodyKey(code[n]);
+            for (int first : candidates)
+			{
+                if (bodyKey(code[first]) == key)
+				{
+                    same[n] = first;
+                    break;
+                }
+            }
+        }
+        if (same[n] == n)
+		{
+            candidates.push_back(n);
+        }
+    }
+    return same;
+}
+
+Decompiler::Result Decompiler::decompileEntry(ScriptEntry const& src, std::ostream& log)
+{
+    Result ret;
+    log_ = &log;
+    fallback_ = false;
+
+    if (skipped(src))
+	{
+        log << "Skipped: " << src.name << std::endl;
+    }
+	else
+	{
+        log << "Processing: " << src.name << std::endl;
         try
         {
             GmAST::ptr_t ptree = decompileScript(src);
             AstTransformer::transform(ptree);
-            proj.addCode(src.name, std::move(ptree));
+            ret.tree = std::move(ptree);
+            ret.fallback = fallback_;
         }
         catch (std::runtime_error& e)
         {
-            std::cout << "  ERROR: " << e.what() << std::endl;
+            log << "  ERROR: " << e.what() << std::endl;
         }
     }
+
+    log_ = &std::cout;
+    return ret;
+}
+
+Decompiler::Result Decompiler::duplicate(ScriptEntry const& src, ScriptEntry const& of, Result const& res)
+{
+    Result ret;
+    ret.log = "Processing: " + src.name + " (same code as " + of.name + ")\n";
+    ret.fallback = res.fallback;
+
+    if (res.fallback)
+	{
+        /* Raw blocks are labelled by address */
+        ret.tree = fallbackScript(src);
+        AstTransformer::transform(ret.tree);
+    }
+	else if (res.tree)
+	{
+        ret.tree = res.tree->deepcopy();
+    }
+    return ret;
+}
+
+void Decompiler::report(ScriptEntry const& src, Result& res, GmxProject& proj, bool keep)
+{
+    if (!res.log.empty())
+	{
+        std::cout << res.log << std::flush;
+    }
+    if (res.fallback)
+	{
+        fallbacks_.push_back(src.name);
+    }
+    if (res.tree)
+	{
+        proj.addCode(src.name, keep ? res.tree->deepcopy() : std::move(res.tree));
+    }
 }
 
 GmAST::ptr_t Decompiler::decompileScript(ScriptEntry const& src)
@@ -126,28 +475,42 @@ GmAST::ptr_t Decompiler::decompileScript(ScriptEntry const& src)
 
     if (options.logAssembly)
 	{
-        std::ofstream(logPrefix + "bytecode.gmasm") << src << std::endl;
+        std::ofstream tmp(logPrefix + "bytecode.gmasm");
+        src.print(tmp, *form_);
+        tmp << std::endl;
     }
 
     FlowGraph::Options fgOpt = FlowGraph::Options::Debug();
-    fgOpt.stepLogPrefix = logPrefix + "fold_step_";
+    fgOpt.traceFile = logPrefix + "fold_trace.bin";
     fgOpt.logSteps = options.logFlowgraph;
+    fgOpt.form = form_;
+    fgOpt.log = log_;
+    fgOpt.maxSteps = options.maxSteps;
+    fgOpt.timeLimit = std::chrono::milliseconds(options.timeLimitMs);
 
-    FlowGraph g(src.code);
+    FlowGraph g(src.code());
     g.options = fgOpt;
 
     if (options.logFlowgraph)
 	{
         std::ofstream tmp(logPrefix + "flowgraph.gml");
-        GraphmlWriter(tmp).print(g);
+        GraphmlWriter(tmp, form_).print(g);
     }
 
     g.analyze();
 
+    addStats(stats_, g.stats());
+
+    if (g.exhausted())
+	{
+        fallback_ = true;
+        return fallbackScript(src);
+    }
+
     if (options.logFlowgraph)
 	{
         std::ofstream tmp(logPrefix + "flowgraph_final.gml");
-        GraphmlWriter(tmp).print(g);
+        GraphmlWriter(tmp, form_).print(g);
     }
 
     ControlTree* ct = g.controlTree();
@@ -155,7 +518,7 @@ GmAST::ptr_t Decompiler::decompileScript(ScriptEntry const& src)
     if (options.logTree)
 	{
         std::ofstream tmp(logPrefix + "control_tree.gml");
-        GraphmlWriter(tmp).print(*ct);
+        GraphmlWriter(tmp, form_).print(*ct);
     }
 
     GmAST::ptr_t ret = analyzeControlTree(ct);
@@ -169,6 +532,112 @@ GmAST::ptr_t Decompiler::decompileScript(ScriptEntry const& src)
     return std::move(ret);
 }
 
+GmAST::ptr_t Decompiler::fallbackScript(ScriptEntry const& src)
+{
+    std::set<int> labels;
+    for (const AsmCommand& cmd : src.code())
+	{
+        if (OperationIsJump(cmd.operation()))
+		{
+            labels.insert(cmd.jumpAddr());
+        }
+    }
+
+    std::vector<GmAST::ptr_t> lines;
+    auto comment = [&lines](std::string text)
+	{
+        /* Pushed strings may close the comment */
+        for (size_t pos = 0; (pos = text.find("*/", pos)) != std::string::npos; )
+		{
+            text.insert(++pos, " ");
+        }
+        lines.push_back(GmAST::make(GmlPattern::Comment, text));
+    };
+    auto label = [](int addr)
+	{
+        char buf[24];
+        sprintf(buf, "label_%08x", addr);
+        return std::string(buf);
+    };
+
+    comment("Structuring budget exceeded, raw blocks follow");
+    int end = 0;
+    for (const AsmCommand& cmd : src.code())
+	{
+        if (labels.count(cmd.addr))
+		{
+            comment(label(cmd.addr) + ":");
+        }
+        switch (cmd.operation())
+		{
+            case (Operation::Jmp):
+                comment("    goto " + label(cmd.jumpAddr()) + ";");
+                break;
+
+            case (Operation::JZ):
+                comment("    if (!pop()) goto " + label(cmd.jumpAddr()) + ";");
+                break;
+
+            case (Operation::JNZ):
+                comment("    if (pop()) goto " + label(cmd.jumpAddr()) + ";");
+                break;
+
+            default:
+			{
+                std::ostringstream line;
+                cmd.print(line, *form_);
+                comment("    " + line.str());
+                break;
+            }
+        }
+        end = cmd.addr + cmd.size();
+    }
+    if (labels.count(end))
+	{
+        comment(label(end) + ":");
+    }
+
+    /* Statements of a block are kept last to first */
+    std::reverse(lines);
+    return GmAST::make(GmlPattern::LinearBlock, std::move(lines));
+}
+
+void Decompiler::printStats() const
+{
+    std::cout << std::left << std::setw(12) << "Pattern"
+              << std::right << std::setw(9) << "hits"
+              << std::setw(12) << "misses"
+              << std::setw(14) << "probe hits"
+              << std::setw(14) << "probe misses" << "\n";
+    for (size_t i = 0; i < stats_.size(); ++i)
+	{
+        std::cout << std::left << std::setw(12) << FlowGraph::PatternName(static_cast<FlowGraph::Pattern>(i))
+                  << std::right << std::setw(9) << stats_[i].hits
+                  << std::setw(12) << stats_[i].misses
+                  << std::setw(14) << stats_[i].probeHits
+                  << std::setw(14) << stats_[i].probeMisses << "\n";
+    }
+}
+
+void Decompiler::printUtilisation(Scheduler const& sched) const
+{
+    using ms = std::chrono::duration<double, std::milli>;
+    const double wall = ms(sched.elapsed()).count();
+
+    std::clog << "Workers: " << sched.size() << ", " << std::fixed << std::setprecision(0) << wall << " ms\n";
+    for (size_t i = 0; i < sched.stats().size(); ++i)
+	{
+        Scheduler::WorkerStats const& st = sched.stats()[i];
+        const double busy = ms(st.busy).count();
+        std::clog << "  #" << std::left << std::setw(3) << i << std::right
+                  << std::setw(6) << st.tasks << " scripts"
+                  << std::setw(5) << st.stolen << " stolen"
+                  << std::setw(8) << busy << " ms"
+                  << std::setw(5) << (wall > 0 ? 100 * busy / wall : 0) << "%\n";
+    }
+    std::clog << std::defaultfloat;
+}
+
 GmAST::ptr_t Decompiler::analyzeControlTree(ControlTree* ct)
 {
     stack_.clear();
@@ -472,7 +941,7 @@ void Decompiler::applyTree(GmlPattern pat, int statc, int exprc)
 
 void Decompiler::applyCall(const AsmCommand& cmd)
 {
-    GmAST::ptr_t t = GmAST::make(GmlPattern::FunctionCall, cmd.symbol);
+    GmAST::ptr_t t = GmAST::make(GmlPattern::FunctionCall, form_->symbolName(cmd));
     for (int i = 0; i < cmd.dataInt16(); ++i)
 	{
         t->addLeaf(pop_back(frame().expr_stack));
@@ -515,7 +984,7 @@ void Decompiler::applyPush(const AsmCommand& cmd)
         case (DataType::Bool):
         case (DataType::Instance):
             // Seems this never happens
-            frame().expr_stack.push_back(GmAST::make(GmlPattern::Invalid, "@push " + DataType2PrettyString(cmd.dataType())));
+            frame().expr_stack.push_back(GmAST::make(GmlPattern::Invalid, std::string("@push ") + DataType2PrettyString(cmd.dataType())));
             break;
     }
 }
@@ -640,7 +1109,7 @@ void Decompiler::applyAssignment(const AsmCommand& cmd)
         lvalue = popVariable(cmd);
     }
 
-    GmAST::ptr_t ret = GmAST::make(GmlPattern::Assignment, cmd.symbol);
+    GmAST::ptr_t ret = GmAST::make(GmlPattern::Assignment, form_->symbolName(cmd));
     ret->addLeaf(std::move(lvalue));
     ret->addLeaf(std::move(rvalue));
     frame().stat_list.push_back(std::move(ret));
@@ -680,7 +1149,7 @@ GmAST::ptr_t Decompiler::popVariable(const AsmCommand& cmd)
         }
     }
 
-    GmAST::ptr_t varTree = GmAST::make(pat, cmd.symbol);
+    GmAST::ptr_t varTree = GmAST::make(pat, form_->symbolName(cmd));
     GmAST::ptr_t varScope = GmAST::make(GmlPattern::VarScope, static_cast<int64_t>(var.scope));
 
     if (arrIndex)
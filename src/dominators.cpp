@@ -0,0 +1,168 @@
+#include "dominators.h"
+
+#include <utility>
+
+
+Dominators::Dominators(std::deque<Node> const& nodes, const Node* entry, bool post)
+    : byId_(nodes.size() + 1, nullptr)
+    , idom_(nodes.size() + 1, -1)
+    , postorder_(nodes.size() + 1, -1)
+    , root_(post ? nodes.size() : entry->id)
+{
+    const int exit = nodes.size();
+
+    for (Node const& n : nodes)
+	{
+        byId_[n.id] = const_cast<Node*>(&n);
+    }
+
+    /* Successors in the walked direction; the virtual exit only leads
+     * somewhere in the reversed graph */
+    std::vector<int> sinks;
+    if (post)
+	{
+        for (Node const& n : nodes)
+		{
+            if (n.alive && n.outputs.empty())
+			{
+                sinks.push_back(n.id);
+            }
+        }
+    }
+    auto successors = [&](int id, size_t i) -> int
+	{
+        if (id == exit)
+		{
+            return i < sinks.size() ? sinks[i] : -1;
+        }
+        Node::links_t const& l = post ? byId_[id]->inputs : byId_[id]->outputs;
+        return i < l.size() ? l[i]->id : -1;
+    };
+    auto predecessors = [&](int id, size_t i) -> int
+	{
+        Node::links_t const& l = post ? byId_[id]->outputs : byId_[id]->inputs;
+        if (i < l.size())
+		{
+            return l[i]->id;
+        }
+        return post && i == l.size() && l.empty() ? exit : -1;
+    };
+
+    /* Iterative depth-first postorder */
+    std::vector<int> order;
+    std::vector<std::pair<int, size_t>> stack;
+    std::vector<char> seen(nodes.size() + 1, 0);
+    stack.emplace_back(root_, 0);
+    seen[root_] = 1;
+    while (!stack.empty())
+	{
+        auto& top = stack.back();
+        int next = successors(top.first, top.second++);
+        if (next < 0)
+		{
+            postorder_[top.first] = order.size();
+            order.push_back(top.first);
+            stack.pop_back();
+        }
+		else if (!seen[next])
+		{
+            seen[next] = 1;
+            stack.emplace_back(next, 0);
+        }
+    }
+
+    /* Refine until stable, visiting in reverse postorder */
+    idom_[root_] = root_;
+    for (bool changed = true; changed; )
+	{
+        changed = false;
+        for (auto it = order.rbegin(); it != order.rend(); ++it)
+		{
+            int b = *it;
+            if (b == root_)
+			{
+                continue;
+            }
+
+            int newIdom = -1;
+            for (size_t i = 0; ; ++i)
+			{
+                int p = predecessors(b, i);
+                if (p < 0)
+				{
+                    break;
+                }
+                if (idom_[p] < 0)
+				{
+                    continue;
+                }
+                newIdom = newIdom < 0 ? p : intersect(p, newIdom);
+            }
+            if (newIdom != idom_[b])
+			{
+                idom_[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool Dominators::reachable(const Node* n) const
+{
+    return static_cast<size_t>(n->id) < idom_.size() - 1 && idom_[n->id] >= 0;
+}
+
+bool Dominators::dominates(const Node* a, const Node* b) const
+{
+    if (!reachable(a) || !reachable(b))
+	{
+        return false;
+    }
+
+    /* Dominators of b sit higher in postorder */
+    int id = b->id;
+    while (postorder_[id] < postorder_[a->id])
+	{
+        id = idom_[id];
+    }
+    return id == a->id;
+}
+
+int Dominators::rank(const Node* n) const
+{
+    return reachable(n) ? postorder_[n->id] : -1;
+}
+
+Dominators::Node* Dominators::immediate(const Node* n) const
+{
+    if (!reachable(n) || n->id == root_)
+	{
+        return nullptr;
+    }
+    return byId_[idom_[n->id]];
+}
+
+Dominators::Node* Dominators::common(const Node* a, const Node* b) const
+{
+    if (!reachable(a) || !reachable(b))
+	{
+        return nullptr;
+    }
+    return byId_[intersect(a->id, b->id)];
+}
+
+int Dominators::intersect(int a, int b) const
+{
+    while (a != b)
+	{
+        while (postorder_[a] < postorder_[b])
+		{
+            a = idom_[a];
+        }
+        while (postorder_[b] < postorder_[a])
+		{
+            b = idom_[b];
+        }
+    }
+    return a;
+}
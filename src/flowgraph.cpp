@@ -1,124 +1,152 @@
 #include "flowgraph.h"
 
 #include <iomanip>
-#include <fstream>
-#include <sstream>
 #include <cassert>
-#include <stack>
 #include <set>
+#include <stdexcept>
+#include <utility>
 
 #include "algext.h"
-#include "graphmlwriter.h"
+#include "dominators.h"
+#include "steptrace.h"
 
 
 FlowGraph::Options FlowGraph::Options::Debug()
 {
     Options ret;
+    ret.form = nullptr;
+    ret.log = &std::cout;
     ret.logSteps = true;
-    ret.stepLogPrefix = "step_";
+    ret.traceFile = "fold_trace.bin";
+    ret.maxSteps = 0;
+    ret.timeLimit = std::chrono::milliseconds::zero();
     return ret;
 }
 
 FlowGraph::Options FlowGraph::Options::Release()
 {
     Options ret;
+    ret.form = nullptr;
+    ret.log = &std::cout;
     ret.logSteps = false;
+    ret.maxSteps = 0;
+    ret.timeLimit = std::chrono::milliseconds::zero();
     return ret;
 }
 
 FlowGraph::FlowGraph()
     : entry_(nullptr)
     , nodes_()
-    , step_(0)
+    , liveCount_(0)
+    , trace_()
+    , lastMatch_(Pattern::Count)
+    , loops_()
+    , matching_()
+    , switchHeaders_()
+    , touched_()
+    , tracking_(false)
+    , orderStale_(false)
+    , walk_()
+    , dirty_()
+    , stats_()
+    , exhausted_(false)
 {}
 
 FlowGraph::FlowGraph(const program_t& p)
     : FlowGraph()
 {
+    /* Instructions are whole words, one slot per word up to the end */
+    const int base = p.empty() ? 0 : p.front().addr;
+    const int last_addr = p.empty() ? 0 : p.back().addr + p.back().size();
+    const size_t slots = (last_addr - base) / 4 + 1;
+
+    auto slot = [&](int addr) -> size_t
+	{
+        if (addr < base || addr > last_addr || (addr - base) % 4)
+		{
+            throw std::runtime_error("Jump outside of script at " + std::to_string(addr));
+        }
+        return (addr - base) / 4;
+    };
+
     /* Find split points */
-    std::vector<int> leaders;
-    int last_addr = 0;
+    std::vector<bool> leaders(slots, false);
     for (const AsmCommand& cmd : p)
 	{
-        if (cmd.operation() == Operation::Jmp ||
-            cmd.operation() == Operation::JZ ||
-            cmd.operation() == Operation::JNZ)
+        if (OperationIsJump(cmd.operation()))
 		{
-            leaders.push_back(cmd.addr + cmd.size);
-            leaders.push_back(cmd.jumpAddr());
+            leaders[slot(cmd.addr + cmd.size())] = true;
+            leaders[slot(cmd.jumpAddr())] = true;
         }
-
-        last_addr = cmd.addr + cmd.size;
     }
-
-    leaders.push_back(last_addr);
-    std::sort(leaders);
-    leaders.erase(std::unique(leaders.begin(), leaders.end()), leaders.end());
-
-    auto ldr = leaders.begin();
-    program_t currentBB;
-    std::map<int, Node*> addr_map;
+    leaders[slots - 1] = true;
 
     /* Create nodes */
-    if (!p.empty() && p.front().addr == *ldr)
-	{
-        ++ldr;
-    }
+    std::vector<Node*> blocks(slots, nullptr);
+    const AsmCommand* first = p.data();
     for (const AsmCommand& cmd : p)
 	{
-        currentBB.push_back(cmd);
-
-        if (cmd.addr + cmd.size == *ldr)
+        if (leaders[slot(cmd.addr + cmd.size())])
 		{
-            Node* n = createTerminal(currentBB);
-            addr_map[n->addr] = n;
-            currentBB.clear();
-            ++ldr;
+            Node* n = createTerminal(first, &cmd + 1);
+            blocks[slot(n->addr)] = n;
+            first = &cmd + 1;
         }
     }
-    Node* nop = createEmptyTerminal(last_addr);
-    addr_map[last_addr] = nop;
+    blocks[slots - 1] = createEmptyTerminal(last_addr);
 
     /* Link nodes */
-    for (auto& ptr : nodes_)
+    auto block = [&](int addr)
 	{
+        Node* ret = blocks[slot(addr)];
+        if (!ret)
+		{
+            throw std::runtime_error("Jump into an instruction at " + std::to_string(addr));
+        }
+        return ret;
+    };
+    for (Node& n : nodes_)
+	{
+        Node* ptr = &n;
         auto& bb = ptr->tree->baseblock();
 
         if (bb.valid())
 		{
             if (bb.hasJumpIfTrue())
 			{
-                addLink(ptr.get(), addr_map.find(bb.jumpTargetAddr())->second);
-                addLink(ptr.get(), addr_map.find(bb.pastTheEndAddr())->second);
+                addLink(ptr, block(bb.jumpTargetAddr()));
+                addLink(ptr, block(bb.pastTheEndAddr()));
 
             }
 			else if (bb.hasJumpIfFalse())
 			{
-                addLink(ptr.get(), addr_map.find(bb.pastTheEndAddr())->second);
-                addLink(ptr.get(), addr_map.find(bb.jumpTargetAddr())->second);
+                addLink(ptr, block(bb.pastTheEndAddr()));
+                addLink(ptr, block(bb.jumpTargetAddr()));
 
             }
 			else if (bb.hasJumpAlways())
 			{
-                addLink(ptr.get(), addr_map.find(bb.jumpTargetAddr())->second);
+                addLink(ptr, block(bb.jumpTargetAddr()));
 
             }
 			else
 			{
-                addLink(ptr.get(), addr_map.find(bb.pastTheEndAddr())->second);
+                addLink(ptr, block(bb.pastTheEndAddr()));
             }
         }
     }
 }
 
+FlowGraph::~FlowGraph() = default;
+
 void FlowGraph::cleanupNops()
 {
     std::vector<Node*> to_erase;
-    for (auto& n : nodes_)
+    for (Node& n : nodes_)
 	{
-        if (n.get() != entry_ && n->isNop() && n->inputsCount() == 0)
+        if (n.alive && &n != entry_ && n.isNop() && n.inputsCount() == 0)
 		{
-            to_erase.push_back(n.get());
+            to_erase.push_back(&n);
         }
     }
     for (Node* n : to_erase)
@@ -127,65 +155,290 @@ void FlowGraph::cleanupNops()
     }
 }
 
-void FlowGraph::rerouteBreakContinue()
+void FlowGraph::findLoops(Dominators const& dom, Dominators const& postDom)
 {
-    std::vector<Node*> loop_headers;
-    for (auto& n : nodes_)
+    const size_t count = nodes_.size();
+
+    /* Loop headers are targets of back edges: links to a dominator.
+     * Inner headers are dominated by outer ones and finish first. */
+    std::vector<Node*> headers;
+    for (Node& n : nodes_)
 	{
-        for (Node* to : n->outputs)
+        for (Node* to : n.outputs)
 		{
-            if (to->addr <= n->addr)
+            if (dom.dominates(to, &n))
 			{
-                loop_headers.push_back(to);
+                headers.push_back(to);
             }
         }
     }
-    std::sort(loop_headers, [](auto a, auto b)
+    std::sort(headers, [&dom](auto a, auto b)
 	{
-        return a->addr > b->addr;
+        return dom.rank(a) < dom.rank(b);
     });
-    loop_headers.erase(std::unique(loop_headers), loop_headers.end());
+    headers.erase(std::unique(headers), headers.end());
 
-    for (Node* hdr : loop_headers) {
-        Node* bottom = *std::max_element(hdr->inputs, [](auto a, auto b)
+    /* Havlak: each finished loop collapses into its header, so a node
+     * is walked once, by its innermost loop */
+    std::vector<int> collapsed(count), innermost(count, -1), seen(count, -1);
+    std::vector<std::vector<Node*>> members;
+    for (size_t i = 0; i < count; ++i)
+	{
+        collapsed[i] = i;
+    }
+    auto find = [&](int id)
+	{
+        int root = id;
+        while (collapsed[root] != root)
 		{
-            return a->addr < b->addr;
-        });
-        Node* pastTheEnd = bottom->outputsCount() == 2 ? bottom->firstOutput() : hdr->lastOutput();
+            root = collapsed[root];
+        }
+        while (collapsed[id] != root)
+		{
+            id = std::exchange(collapsed[id], root);
+        }
+        return root;
+    };
+
+    loops_.clear();
+    for (Node* hdr : headers)
+	{
+        const int loop = loops_.size();
+        Loop l;
+        l.header = hdr;
+        l.bottom = nullptr;
+        l.exit = nullptr;
+        l.parent = -1;
+
+        hdr->loop = loop;
+        innermost[hdr->id] = loop;
+        seen[hdr->id] = loop;
+        members.emplace_back(1, hdr);
+
+        std::vector<Node*>& store = walk_.stack;
+        store.clear();
+        for (Node* in : hdr->inputs)
+		{
+            if (dom.dominates(hdr, in))
+			{
+                if (!l.bottom || in->addr > l.bottom->addr)
+				{
+                    l.bottom = in;
+                }
+                store.push_back(&nodes_[find(in->id)]);
+            }
+        }
+        while (!store.empty())
+		{
+            Node* n = store.back();
+            store.pop_back();
+            if (seen[n->id] == loop)
+			{
+                continue;
+            }
+            seen[n->id] = loop;
+            collapsed[n->id] = hdr->id;
+
+            if (n->loop >= 0)
+			{
+                loops_[n->loop].parent = loop;
+            }
+			else
+			{
+                innermost[n->id] = loop;
+                members[loop].push_back(n);
+            }
+            /* Inputs the header doesn't dominate enter an irreducible
+             * region from outside, they are not part of the loop */
+            for (Node* in : n->inputs)
+			{
+                if (dom.reachable(in) && dom.dominates(hdr, in))
+				{
+                    store.push_back(&nodes_[find(in->id)]);
+                }
+            }
+        }
+        loops_.push_back(l);
+    }
 
-        depthFirstWalk(hdr, [&](Node * node) mutable
+    auto contains = [&](int loop, Node* n)
+	{
+        for (int l = innermost[n->id]; l >= 0; l = loops_[l].parent)
 		{
-            if (node == pastTheEnd)
-            {
-                return VisitResult::Continue;
+            if (l == loop)
+			{
+                return true;
             }
-            if (node != hdr && node != bottom)
-            {
-                if (removeLink(node, hdr))
+        }
+        return false;
+    };
+
+    /* Breaks go to the nearest node post-dominating all exits. When the
+     * exits don't meet, fall back to the layout the compiler uses for
+     * while and do/until loops. */
+    std::vector<std::vector<Node*>> exits(loops_.size());
+    for (size_t i = 0; i < loops_.size(); ++i)
+	{
+        Loop& l = loops_[i];
+        std::vector<Node*> targets;
+        for (Node* m : members[i])
+		{
+            for (Node* out : m->outputs)
+			{
+                if (!contains(i, out))
 				{
-                    Node* to = fallthroughNode(node);
-                    Node* ncontinue = mergeNodes(ControlTree::Type::Continue, { createEmptyTerminal() });
-                    addLink(node, ncontinue);
-                    addLink(ncontinue, to);
+                    targets.push_back(out);
                 }
-                if (removeLink(node, pastTheEnd))
+            }
+        }
+        for (Node* out : exits[i])
+		{
+            if (!contains(i, out))
+			{
+                targets.push_back(out);
+            }
+        }
+
+        for (Node* out : targets)
+		{
+            if (l.exit != out)
+			{
+                l.exit = l.exit ? postDom.common(l.exit, out) : out;
+            }
+            if (!l.exit || contains(i, l.exit))
+			{
+                l.exit = nullptr;
+                break;
+            }
+        }
+        if (!l.exit)
+		{
+            l.exit = l.bottom->outputsCount() == 2 ? l.bottom->firstOutput() : l.header->lastOutput();
+        }
+
+        if (l.parent >= 0)
+		{
+            exits[l.parent].insert(exits[l.parent].end(), targets.begin(), targets.end());
+        }
+    }
+}
+
+void FlowGraph::rerouteBreakContinue(Dominators const& dom)
+{
+    const size_t known = nodes_.size();
+
+    /* Jump targets by address, nodes made below are looked up the slow way */
+    std::map<int, Node*> byAddr;
+    for (Node& n : nodes_)
+	{
+        if (n.alive)
+		{
+            byAddr.emplace(n.addr, &n);
+        }
+    }
+    auto fallthrough = [&](Node* n)
+	{
+        auto it = byAddr.find(n->pastTheEndAddr);
+        return it != byAddr.end() && it->second->alive ? it->second : fallthroughNode(n);
+    };
+
+    std::vector<Loop*> loops;
+    for (Loop& l : loops_)
+	{
+        loops.push_back(&l);
+    }
+    std::sort(loops, [](auto a, auto b)
+	{
+        return a->header->addr > b->header->addr;
+    });
+
+    for (Loop* l : loops) {
+        Node* hdr = l->header;
+        Node* bottom = l->bottom;
+        Node* pastTheEnd = l->exit;
+
+        /* repeat() latches branch back on true, those loops keep their jumps */
+        if (bottom->outputsCount() == 2 && bottom->firstOutput() == hdr)
+		{
+            continue;
+        }
+
+        /* A while condition made of && or || is a chain of nodes ending
+         * in the test that leaves the loop. The test dominates the body,
+         * breaks in the body included, so it is the exit source nearest
+         * the header among those on the way to the latch. */
+        Node* test = nullptr;
+        for (Node* in : pastTheEnd->inputs)
+		{
+            if (static_cast<size_t>(in->id) < known && in != bottom && in->outputsCount() == 2 &&
+                dom.dominates(hdr, in) && dom.dominates(in, bottom) &&
+                (!test || dom.dominates(in, test)))
+			{
+                test = in;
+            }
+        }
+
+        /* Only links into the header and the exit are rerouted. Their
+         * sources count if the loop reaches them before leaving: the
+         * header dominates them and the exit doesn't. The condition
+         * chain, the nodes the test doesn't dominate, exits normally.
+         * Nodes made for inner loops stand for the node they were split
+         * from. */
+        bool exitAbove = dom.dominates(pastTheEnd, hdr);
+        auto inLoop = [&](Node* n)
+		{
+            while (static_cast<size_t>(n->id) >= known)
+			{
+                n = n->inputs.front();
+            }
+            return n != hdr && n != bottom && n != pastTheEnd && n != test &&
+                   dom.dominates(hdr, n) &&
+                   (!test || dom.dominates(test, n)) &&
+                   (exitAbove || !dom.dominates(pastTheEnd, n));
+        };
+
+        std::vector<Node*> sources;
+        for (Node* target : { hdr, pastTheEnd })
+		{
+            for (Node* in : target->inputs)
+			{
+                if (inLoop(in))
 				{
-                    Node* to = fallthroughNode(node);
-                    Node* term = createEmptyTerminal();
-                    Node* nbreak = mergeNodes(ControlTree::Type::Break, { term });
-                    addLink(node, nbreak);
-                    addLink(nbreak, to);
+                    sources.push_back(in);
                 }
             }
-            return VisitResult::None;
+        }
+        std::sort(sources, [](auto a, auto b)
+		{
+            return a->id > b->id;
         });
+        sources.erase(std::unique(sources), sources.end());
+
+        for (Node* node : sources)
+		{
+            if (removeLink(node, hdr))
+			{
+                Node* to = fallthrough(node);
+                Node* ncontinue = mergeNodes(ControlTree::Type::Continue, { createEmptyTerminal() });
+                addLink(node, ncontinue);
+                addLink(ncontinue, to);
+            }
+            if (removeLink(node, pastTheEnd))
+			{
+                Node* to = fallthrough(node);
+                Node* term = createEmptyTerminal();
+                Node* nbreak = mergeNodes(ControlTree::Type::Break, { term });
+                addLink(node, nbreak);
+                addLink(nbreak, to);
+            }
+        }
     }
 }
 
 void FlowGraph::analyze()
 {
     /* If empty -> exit */
-    if (nodes_.empty())
+    if (liveCount_ == 0)
 	{
         return;
     }
@@ -195,53 +448,276 @@ void FlowGraph::analyze()
 
     /* Detect loops */
     /* For each loop: detect break/continue */
-    rerouteBreakContinue();
+    Dominators dom(nodes_, entry_, false);
+    Dominators postDom(nodes_, entry_, true);
+    findLoops(dom, postDom);
+    rerouteBreakContinue(dom);
 
-    logSelf();
+    if (options.logSteps)
+	{
+        trace_ = std::make_unique<StepTraceWriter>(options.traceFile, options.form);
+    }
+    logSelf(Pattern::Count);
 
     /* While changed: try match */
     analyzeImpl();
 
     /* Assert number of nodes == 1 */
-    if (nodes_.size() > 1)
+    if (exhausted_)
+	{
+        *options.log << "  Budget exceeded: " << std::setw(4) << liveCount_ << " nodes left!\n";
+    }
+	else if (liveCount_ > 1)
 	{
-        std::cout << "  Failed to simplify graph: " << std::setw(4) << nodes_.size() << " nodes left!\n";
+        *options.log << "  Failed to simplify graph: " << std::setw(4) << liveCount_ << " nodes left!\n";
     }
 }
 
 void FlowGraph::analyzeImpl()
 {
-    for (bool changed = true; changed;)
+    /* Same reductions as rescanning the reverse-depth-first order after
+     * every match: the node latest in walk order among matching ones is
+     * reduced first. Only nodes around a merge are rechecked. */
+    renumber();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int steps = 0; !matching_.empty(); ++steps)
 	{
-        /* Walk graph in reverse-depth-first order */
-        std::vector<Node*> dftree;
-        depthFirstWalk(entry_, [&dftree](Node * node) mutable
+        if (outOfBudget(steps, start))
 		{
-            dftree.push_back(node);
-            return VisitResult::None;
-        });
-        std::reverse(dftree);
-
-        /* Match patterns */
-        changed = false;
-        for (Node* node : dftree)
-		{
-            if (matchedBlock(node) ||
-                matchedAnd(node) ||
-                matchedOr(node) ||
-                matchedSwitch(node) ||
-                matchedIf(node) ||
-                matchedIfElse(node) ||
-                matchedRepeat(node) ||
-                matchedLoop(node) ||
-                matchedNaturalLoop(node))
+            exhausted_ = true;
+            return;
+        }
+
+        Node* node = std::prev(matching_.end())->second;
+
+        touched_.clear();
+        tracking_ = true;
+        orderStale_ = false;
+
+        bool matched = tryMatch(node, true);
+        assert(matched);
+        (void)matched;
+
+        tracking_ = false;
+        logSelf(lastMatch_);
+
+        if (orderStale_)
+		{
+            renumber();
+        }
+		else
+		{
+            requeue();
+        }
+    }
+}
+
+bool FlowGraph::outOfBudget(int steps, std::chrono::steady_clock::time_point start) const
+{
+    if (options.maxSteps > 0 && steps >= options.maxSteps)
+	{
+        return true;
+    }
+
+    /* Reading the clock costs more than a step */
+    return options.timeLimit.count() > 0 && steps % 64 == 0 &&
+           std::chrono::steady_clock::now() - start > options.timeLimit;
+}
+
+namespace
+{
+    unsigned bit(FlowGraph::Pattern p)
+    {
+        return 1u << static_cast<unsigned>(p);
+    }
+}
+
+const char* FlowGraph::PatternName(Pattern p)
+{
+    static const char* const names[] = {
+        "Block", "And", "Or", "Switch", "If", "IfElse", "Repeat", "Loop", "NaturalLoop"
+    };
+    return names[static_cast<size_t>(p)];
+}
+
+const FlowGraph::stats_t& FlowGraph::stats() const
+{
+    return stats_;
+}
+
+bool FlowGraph::exhausted() const
+{
+    return exhausted_;
+}
+
+unsigned FlowGraph::candidates(Node* n) const
+{
+    /* Shape: degrees, constant branches, switch markers, loop headers
+     * and back edges */
+    if (n->outputsCount() == 1)
+	{
+        return n->output()->inputsCount() == 1 ? bit(Pattern::Block) : 0;
+    }
+    if (n->outputsCount() != 2)
+	{
+        return 0;
+    }
+
+    unsigned ret = 0;
+    if (n->lastOutput()->isNumber(0))
+	{
+        ret |= bit(Pattern::And);
+    }
+    if (n->firstOutput()->isNumber(1))
+	{
+        ret |= bit(Pattern::Or);
+    }
+    if (n->lastOutput()->loop >= 0 && n->lastOutput()->outputsCount() == 2 && n->lastOutput()->firstOutput() == n->lastOutput())
+	{
+        ret |= bit(Pattern::Repeat);
+    }
+    if (n->isSwitchHeader())
+	{
+        ret |= bit(Pattern::Switch);
+    }
+    if (!n->isSwitchCase())
+	{
+        ret |= bit(Pattern::If) | bit(Pattern::IfElse);
+    }
+    if (n->loop >= 0)
+	{
+        ret |= bit(Pattern::Loop);
+        if (n->lastOutput() == n)
+		{
+            ret |= bit(Pattern::NaturalLoop);
+        }
+    }
+    return ret;
+}
+
+bool FlowGraph::tryMatch(Node* n, bool apply)
+{
+    using matcher_t = bool (FlowGraph::*)(Node*, bool);
+    static const matcher_t matchers[] = {
+        &FlowGraph::matchedBlock,
+        &FlowGraph::matchedAnd,
+        &FlowGraph::matchedOr,
+        &FlowGraph::matchedSwitch,
+        &FlowGraph::matchedIf,
+        &FlowGraph::matchedIfElse,
+        &FlowGraph::matchedRepeat,
+        &FlowGraph::matchedLoop,
+        &FlowGraph::matchedNaturalLoop,
+    };
+
+    unsigned mask = candidates(n);
+    for (size_t i = 0; mask >> i; ++i)
+	{
+        if (!(mask & (1u << i)))
+		{
+            continue;
+        }
+        PatternStats& st = stats_[i];
+        if ((this->*matchers[i])(n, apply))
+		{
+            ++(apply ? st.hits : st.probeHits);
+            if (apply)
 			{
-                logSelf();
-                changed = true;
-                break;
+                lastMatch_ = static_cast<Pattern>(i);
             }
+            return true;
+        }
+        ++(apply ? st.misses : st.probeMisses);
+    }
+    return false;
+}
+
+void FlowGraph::renumber()
+{
+    for (Node& n : nodes_)
+	{
+        n.order = -1;
+    }
+
+    int order = 0;
+    depthFirstWalk(entry_, [&order](Node * node) mutable
+	{
+        node->order = order++;
+        return VisitResult::None;
+    });
+
+    matching_.clear();
+    switchHeaders_.clear();
+    for (Node& n : nodes_)
+	{
+        if (n.order < 0)
+		{
+            continue;
+        }
+        if (n.tree->isSwitchHeader())
+		{
+            switchHeaders_.insert(&n);
+        }
+        if (tryMatch(&n, false))
+		{
+            matching_[n.order] = &n;
+        }
+    }
+}
+
+void FlowGraph::requeue()
+{
+    /* Matchers look one link ahead, so a change is visible to the node
+     * itself and its inputs. Switch headers look down the whole chain. */
+    std::vector<Node*>& dirty = dirty_.stack;
+    dirty.clear();
+    auto mark = [this, &dirty](Node* n)
+	{
+        if (dirty_.seen.insert(n))
+		{
+            dirty.push_back(n);
+        }
+    };
+    for (Node* n : switchHeaders_)
+	{
+        mark(n);
+    }
+    for (Node* n : touched_)
+	{
+        mark(n);
+        for (Node* in : n->inputs)
+		{
+            mark(in);
         }
     }
+
+    for (Node* n : dirty)
+	{
+        dirty_.seen.erase(n);
+        if (n->order < 0)
+		{
+            continue;
+        }
+
+        auto it = matching_.find(n->order);
+        if (it != matching_.end() && it->second == n)
+		{
+            matching_.erase(it);
+        }
+        if (tryMatch(n, false))
+		{
+            matching_[n->order] = n;
+        }
+    }
+}
+
+void FlowGraph::touch(Node* n)
+{
+    if (tracking_)
+	{
+        touched_.push_back(n);
+    }
 }
 
 FlowGraph::Node::Node(int addr)
@@ -250,6 +726,10 @@ FlowGraph::Node::Node(int addr)
     , tree(std::make_unique<ControlTree>())
     , addr(addr)
     , pastTheEndAddr(-1)
+    , order(-1)
+    , id(-1)
+    , loop(-1)
+    , alive(true)
 {}
 
 FlowGraph::Node::Node(ControlTree::ptr_t ct)
@@ -258,6 +738,10 @@ FlowGraph::Node::Node(ControlTree::ptr_t ct)
     , tree(std::move(ct))
     , addr(tree->addr())
     , pastTheEndAddr(tree->pastTheEndAddr())
+    , order(-1)
+    , id(-1)
+    , loop(-1)
+    , alive(true)
 {}
 
 int FlowGraph::Node::outputsCount() const
@@ -324,7 +808,7 @@ ControlTree* FlowGraph::controlTree()
     return entry_->tree.get();
 }
 
-bool FlowGraph::matchedBlock(Node* n)
+bool FlowGraph::matchedBlock(Node* n, bool apply)
 {
     if (n->outputsCount() != 1 ||
         n->output()->inputsCount() != 1 ||
@@ -337,13 +821,17 @@ bool FlowGraph::matchedBlock(Node* n)
 	{
         return false;
     }
+    if (!apply)
+	{
+        return true;
+    }
     mergeNodes(ControlTree::Type::LinearBlock, { n, s });
     return true;
 }
 
-bool FlowGraph::matchedLoop(Node* n)
+bool FlowGraph::matchedLoop(Node* n, bool apply)
 {
-    if (n->outputsCount() != 2) {
+    if (n->loop < 0 || n->outputsCount() != 2) {
         return false;
     }
     Node* body = n->firstOutput();
@@ -353,24 +841,33 @@ bool FlowGraph::matchedLoop(Node* n)
 	{
         return false;
     }
+    if (!apply)
+	{
+        return true;
+    }
     removeLink(body, n);
     mergeNodes(ControlTree::Type::LoopWithHeader, { n, body });
     return true;
 }
 
-bool FlowGraph::matchedNaturalLoop(Node* n)
+bool FlowGraph::matchedNaturalLoop(Node* n, bool apply)
 {
-    if (n->outputsCount() != 2 ||
+    if (n->loop < 0 ||
+        n->outputsCount() != 2 ||
         n->lastOutput() != n)
 	{
         return false;
     }
+    if (!apply)
+	{
+        return true;
+    }
     removeLink(n, n);
     mergeNodes(ControlTree::Type::NaturalLoop, { n });
     return true;
 }
 
-bool FlowGraph::matchedRepeat(Node* n)
+bool FlowGraph::matchedRepeat(Node* n, bool apply)
 {
     if (n->outputsCount() != 2)
 	{
@@ -378,20 +875,25 @@ bool FlowGraph::matchedRepeat(Node* n)
     }
 
     Node* body = n->lastOutput();
-    if (body->outputsCount() != 2 ||
+    if (body->loop < 0 ||
+        body->outputsCount() != 2 ||
         body->firstOutput() != body ||
         body->lastOutput() != n->firstOutput())
 	{
         return false;
     }
 
+    if (!apply)
+	{
+        return true;
+    }
     removeLink(body, body);
     mergeNodes(ControlTree::Type::RepeatLoop, { n, body, body->output() });
 
     return true;
 }
 
-bool FlowGraph::matchedIf(Node* n)
+bool FlowGraph::matchedIf(Node* n, bool apply)
 {
     if (n->outputsCount() != 2)
 	{
@@ -407,11 +909,15 @@ bool FlowGraph::matchedIf(Node* n)
 	{
         return false;
     }
+    if (!apply)
+	{
+        return true;
+    }
     mergeNodes(ControlTree::Type::If, { n, brTrue });
     return true;
 }
 
-bool FlowGraph::matchedIfElse(Node* n)
+bool FlowGraph::matchedIfElse(Node* n, bool apply)
 {
     if (n->outputsCount() != 2)
 	{
@@ -430,11 +936,15 @@ bool FlowGraph::matchedIfElse(Node* n)
 	{
         return false;
     }
+    if (!apply)
+	{
+        return true;
+    }
     mergeNodes(ControlTree::Type::IfElse, { n, brTrue, brFalse });
     return true;
 }
 
-bool FlowGraph::matchedAnd(Node* n)
+bool FlowGraph::matchedAnd(Node* n, bool apply)
 {
     if (n->outputsCount() != 2)
 	{
@@ -453,18 +963,26 @@ bool FlowGraph::matchedAnd(Node* n)
         return false;
     }
 
+    if (!apply)
+	{
+        return true;
+    }
     removeLink(n, br_zero);
     if (br_zero->inputsCount() == 0)
 	{
         eraseNode(br_zero);
     }
+	else
+	{
+        orderStale_ = true;
+    }
 
     mergeNodes(ControlTree::Type::And, { n, br_b });
 
     return true;
 }
 
-bool FlowGraph::matchedOr(Node* n)
+bool FlowGraph::matchedOr(Node* n, bool apply)
 {
     if (n->outputsCount() != 2)
 	{
@@ -483,18 +1001,26 @@ bool FlowGraph::matchedOr(Node* n)
         return false;
     }
 
+    if (!apply)
+	{
+        return true;
+    }
     removeLink(n, br_one);
     if (br_one->inputsCount() == 0)
 	{
         eraseNode(br_one);
     }
+	else
+	{
+        orderStale_ = true;
+    }
 
     mergeNodes(ControlTree::Type::Or, { n, br_b });
 
     return true;
 }
 
-bool FlowGraph::matchedSwitch(Node* n)
+bool FlowGraph::matchedSwitch(Node* n, bool apply)
 {
     /* 1. Check header */
     if (!n->isSwitchHeader())
@@ -539,6 +1065,14 @@ bool FlowGraph::matchedSwitch(Node* n)
         return false;
     }
 
+    if (!apply)
+	{
+        return true;
+    }
+
+    /* Cases are merged piecewise, the walk order has to be rebuilt */
+    orderStale_ = true;
+
     /* 5. Find actions */
     std::vector<Node*> actions(checks.size(), nullptr);
     std::vector<char> has_break(checks.size(), 0);
@@ -603,6 +1137,8 @@ bool FlowGraph::addLink(Node* a, Node* b)
 {
     if (!hasLink(a, b))
 	{
+        touch(a);
+        touch(b);
         a->outputs.push_back(b);
         b->inputs.push_back(a);
         return true;
@@ -612,34 +1148,32 @@ bool FlowGraph::addLink(Node* a, Node* b)
 
 FlowGraph::Node* FlowGraph::fallthroughNode(Node* n)
 {
-    auto it = std::find_if(nodes_, [n](auto & ptr)
+    auto it = std::find_if(nodes_, [n](const Node& other)
 	{
-        return ptr->addr == n->pastTheEndAddr;
+        return other.alive && other.addr == n->pastTheEndAddr;
     });
     if (it == nodes_.end())
 	{
         return nullptr;
     }
-    return it->get();
+    return &*it;
 }
 
-FlowGraph::Node* FlowGraph::createTerminal(program_t& p)
+FlowGraph::Node* FlowGraph::createTerminal(const AsmCommand* first, const AsmCommand* last)
 {
-    BaseBlock bb(p);
+    BaseBlock bb(first, last);
     auto ct = std::make_unique<ControlTree>(bb);
-    auto pn = std::make_unique<Node>(std::move(ct));
+    Node* pn = createNode(std::move(ct));
     if (!entry_)
 	{
-        entry_ = pn.get();
+        entry_ = pn;
     }
-    nodes_.push_back(std::move(pn));
-    return nodes_.back().get();
+    return pn;
 }
 
 FlowGraph::Node* FlowGraph::createEmptyTerminal(int addr)
 {
-    nodes_.push_back(std::make_unique<Node>(addr));
-    Node* ret = nodes_.back().get();
+    Node* ret = createNode(addr);
     if (!entry_)
 	{
         entry_ = ret;
@@ -668,15 +1202,17 @@ bool FlowGraph::removeLink(Node* a, Node* b)
 	{
         return false;
     }
+    touch(a);
+    touch(b);
     a->outputs.erase(std::find(a->outputs, b));
     b->inputs.erase(std::find(b->inputs, a));
     return true;
 }
 
 void replace_with_vector(
-    std::vector<FlowGraph::Node*>& dest,
+    FlowGraph::Node::links_t& dest,
     FlowGraph::Node* val,
-    std::vector<FlowGraph::Node*>& src)
+    const std::vector<FlowGraph::Node*>& src)
 {
     auto it = std::find_if(dest, [val](auto ptr)
 	{
@@ -708,30 +1244,43 @@ void FlowGraph::eraseNode(Node* n)
         entry_ = entry_->output();
     }
 
-    auto equals = [n](const std::unique_ptr<Node>& ptr)
-	{
-        return ptr.get() == n;
-    };
-    auto it = std::find_if(nodes_, equals);
-    assert(it != nodes_.end());
+    assert(n->alive);
 
-    std::vector<Node*> inputs(n->inputs);
-    std::vector<Node*> outputs(n->outputs);
+    std::vector<Node*> inputs(n->inputs.begin(), n->inputs.end());
+    std::vector<Node*> outputs(n->outputs.begin(), n->outputs.end());
 
     for (Node* in : inputs)
 	{
+        touch(in);
         replace_with_vector(in->outputs, n, outputs);
     }
 
     for (Node* out : outputs)
 	{
+        touch(out);
         replace_with_vector(out->inputs, n, inputs);
     }
 
-    n->inputs.clear();
-    n->outputs.clear();
+    n->inputs.shrink();
+    n->outputs.shrink();
+
+    /* Forget the node in reduction state before it is freed */
+    if (trace_)
+	{
+        trace_->erase(*n);
+    }
+    touched_.erase(std::remove(touched_.begin(), touched_.end(), n), touched_.end());
+    switchHeaders_.erase(n);
+    auto queued = matching_.find(n->order);
+    if (n->order >= 0 && queued != matching_.end() && queued->second == n)
+	{
+        matching_.erase(queued);
+    }
 
-    nodes_.erase(it);
+    /* Tombstone: the slot keeps its id, pointers to it stay valid */
+    n->alive = false;
+    n->tree.reset();
+    --liveCount_;
 }
 
 void FlowGraph::insertBefore(Node* pos, Node* val)
@@ -743,8 +1292,11 @@ void FlowGraph::insertBefore(Node* pos, Node* val)
         entry_ = val;
     }
 
+    touch(pos);
+    touch(val);
     for (Node* in : pos->inputs)
 	{
+        touch(in);
         std::replace(in->outputs, pos, val);
         val->inputs.push_back(in);
     }
@@ -754,12 +1306,11 @@ void FlowGraph::insertBefore(Node* pos, Node* val)
     addLink(val, pos);
 }
 
-void FlowGraph::logSelf()
+void FlowGraph::logSelf(Pattern p)
 {
-    if (options.logSteps)
+    if (trace_)
 	{
-        std::ofstream tmp(options.stepLogPrefix + std::to_string(step_++) + ".gml");
-        GraphmlWriter(tmp).print(*this);
+        trace_->step(*this, p);
     }
 }
 
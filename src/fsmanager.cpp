@@ -38,15 +38,33 @@ void FsManager::directoryDelete(const std::wstring& path)
     }
 }
 
+void FsManager::fileDelete(const std::wstring& path)
+{
+    if (!DeleteFile(path.c_str()) && GetLastError() != ERROR_FILE_NOT_FOUND)
+	{
+        throw std::runtime_error("Cannot delete file: " + narrow(path));
+    }
+}
+
+void FsManager::fileReplace(const std::wstring& from, const std::wstring& to)
+{
+    if (!MoveFileEx(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+        throw std::runtime_error("Cannot replace file: " + narrow(to));
+    }
+}
+
 #else
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <cerrno>
+#include <cstdio>
 
 void FsManager::directoryCreate(const std::wstring& path)
 {
     std::string p(path.begin(), path.end());
-    if (mkdir(p.c_str(), 0755))
+    if (mkdir(p.c_str(), 0755) && errno != EEXIST)
 	{
         throw std::runtime_error("Cannot create directory " + p);
     }
@@ -61,4 +79,23 @@ void FsManager::directoryDelete(const std::wstring& path)
     }
 }
 
+void FsManager::fileDelete(const std::wstring& path)
+{
+    std::string p(path.begin(), path.end());
+    if (unlink(p.c_str()) && errno != ENOENT)
+	{
+        throw std::runtime_error("Cannot delete file " + p);
+    }
+}
+
+void FsManager::fileReplace(const std::wstring& from, const std::wstring& to)
+{
+    std::string f(from.begin(), from.end());
+    std::string t(to.begin(), to.end());
+    if (rename(f.c_str(), t.c_str()))
+	{
+        throw std::runtime_error("Cannot replace file " + t);
+    }
+}
+
 #endif
@@ -180,6 +180,7 @@ const char* GmlPattern2String(GmlPattern p)
 		CASE_RETURN_SCOPED(GmlPattern, SwitchCase)
 		CASE_RETURN_SCOPED(GmlPattern, SwitchDefault)
 		CASE_RETURN_SCOPED(GmlPattern, With)
+		CASE_RETURN_SCOPED(GmlPattern, Comment)
     }
     return "???";
 }
@@ -220,6 +221,7 @@ bool GmlNeedsPadding(GmlPattern p)
         case (GmlPattern::Assignment):
         case (GmlPattern::CompoundAssignment):
         case (GmlPattern::Exit):
+        case (GmlPattern::Comment):
             return false;
     }
 
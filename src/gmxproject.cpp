@@ -1,10 +1,13 @@
 #include "gmxproject.h"
 
 #include <fstream>
+#include <utility>
 
 #include "fsmanager.h"
 #include "utils.h"
 #include "gmlwriter.h"
+#include "gmform.h"
+#include "scheduler.h"
 
 GmxProject::GmxProject()
 {}
@@ -32,41 +35,77 @@ void GmxProject::exportGmx(GmForm& f, std::string const& dir)
         ? (dir + "/" + options.scriptsDir + "/")
         : codePrefix;
 
+    for (std::string const& name : dropped_)
+    {
+        const char* script = ScriptName(name);
+        FsManager::fileDelete(wide(script ? scriptsPrefix + script + ".gml" : codePrefix + name + ".gml"));
+    }
+
+    std::vector<std::pair<std::string, const GmAST*>> files;
     for (auto& kv : scripts_)
     {
-        std::ofstream tmp(scriptsPrefix + kv.first + ".gml");
-        GmlWriter(tmp, f).print(*kv.second.ast);
+        files.emplace_back(scriptsPrefix + kv.first + ".gml", kv.second.ast.get());
     }
     for (auto& kv : codes_)
     {
-        std::ofstream tmp(codePrefix + kv.first + ".gml");
-        GmlWriter(tmp, f).print(*kv.second);
+        files.emplace_back(codePrefix + kv.first + ".gml", kv.second.get());
     }
-}
 
-void GmxProject::addCode(std::string const& full_name, GmAST::ptr_t ast)
-{
-    static const char prefix[] = "gml_Script_";
+    auto write = [&f, &files](int, int i)
+    {
+        std::ofstream tmp(files[i].first);
+        GmlWriter(tmp, f).print(*files[i].second);
+    };
 
-    for (size_t i = 0; i < full_name.size(); ++i)
+    if (options.threads == 1)
     {
-        // Code is script
-        if (prefix[i] == '\0')
+        for (size_t i = 0; i < files.size(); ++i)
         {
-            GmlScript scr{
-                full_name,
-                {},
-                std::move(ast)
-            };
-
-            std::string short_name(&full_name[i]);
-
-            scripts_[short_name] =  std::move(scr);
-            return;
+            write(0, i);
         }
+    }
+    else
+    {
+        /* Writers look up resource names: chunks are parsed on first
+         * access, so all of them are loaded up front */
+        f.preload(options.threads, true);
+
+        Scheduler sched(options.threads);
+        sched.run(std::vector<uint64_t>(files.size(), 1), write);
+    }
+}
 
-        if (prefix[i] != full_name[i]) { break; }
+void GmxProject::addCode(std::string const& full_name, GmAST::ptr_t ast)
+{
+    // Code is script
+    if (const char* short_name = ScriptName(full_name))
+    {
+        GmlScript scr{
+            full_name,
+            {},
+            std::move(ast)
+        };
+
+        scripts_[short_name] =  std::move(scr);
+        return;
     }
 
     codes_[full_name] = std::move(ast);
 }
+
+void GmxProject::dropCode(std::string const& full_name)
+{
+    dropped_.push_back(full_name);
+}
+
+const char* GmxProject::ScriptName(std::string const& full_name)
+{
+    static const char prefix[] = "gml_Script_";
+    const size_t len = sizeof(prefix) - 1;
+
+    if (full_name.size() > len && !full_name.compare(0, len, prefix))
+    {
+        return full_name.c_str() + len;
+    }
+    return nullptr;
+}
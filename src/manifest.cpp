@@ -0,0 +1,120 @@
+#include "manifest.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "gmform.h"
+#include "utils.h"
+
+#define MANIFEST_VERSION 2
+
+
+namespace
+{
+    const char Magic[] = "GMSDCMAN";
+
+    template<class Chunk>
+    uint64_t hashNames(Chunk const& ch, uint64_t h)
+    {
+        uint32_t count = ch.count();
+        h = hash_bytes(&count, sizeof(count), h);
+        for (auto const& entry : ch)
+        {
+            /* Lengths keep "ab","c" apart from "a","bc" */
+            uint32_t len = entry.name.size();
+            h = hash_bytes(&len, sizeof(len), h);
+            h = hash_bytes(entry.name.data(), len, h);
+        }
+        return h;
+    }
+}
+
+
+uint64_t Manifest::Key(GmForm const& f, Decompiler::Options const& opt)
+{
+    const int32_t settings[] = {
+        MANIFEST_VERSION,
+        Decompiler::OutputVersion,
+        opt.maxSteps,
+        opt.timeLimitMs,
+    };
+    uint64_t h = hash_bytes(settings, sizeof(settings));
+
+    /* Chunks GmlWriter names constants from */
+    h = hashNames(f.sprites(), h);
+    h = hashNames(f.sounds(), h);
+    h = hashNames(f.backgrounds(), h);
+    h = hashNames(f.paths(), h);
+    h = hashNames(f.scripts(), h);
+    h = hashNames(f.shaders(), h);
+    h = hashNames(f.fonts(), h);
+    h = hashNames(f.timelines(), h);
+    h = hashNames(f.objects(), h);
+    h = hashNames(f.rooms(), h);
+    return h;
+}
+
+Manifest Manifest::Read(std::string const& path)
+{
+    Manifest ret;
+    std::ifstream in(path);
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version) || magic != Magic || version != MANIFEST_VERSION)
+    {
+        return ret;
+    }
+
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        uint64_t hash;
+        std::string name;
+        if (!(fields >> std::hex >> hash >> std::ws) || !std::getline(fields, name))
+        {
+            throw std::runtime_error("Bad manifest line in " + path + ": " + line);
+        }
+        ret.scripts_[name] = hash;
+    }
+    return ret;
+}
+
+void Manifest::write(std::string const& path) const
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("Cannot write manifest " + path);
+    }
+
+    out << Magic << " " << MANIFEST_VERSION << "\n" << std::hex << std::setfill('0');
+    for (auto const& kv : scripts_)
+    {
+        out << std::setw(16) << kv.second << " " << kv.first << "\n";
+    }
+}
+
+bool Manifest::empty() const
+{
+    return scripts_.empty();
+}
+
+bool Manifest::contains(std::string const& name, uint64_t hash) const
+{
+    auto it = scripts_.find(name);
+    return it != scripts_.end() && it->second == hash;
+}
+
+void Manifest::add(std::string const& name, uint64_t hash)
+{
+    scripts_[name] = hash;
+}
+
+std::map<std::string, uint64_t> const& Manifest::scripts() const
+{
+    return scripts_;
+}
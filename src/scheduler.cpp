@@ -0,0 +1,129 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <future>
+#include <numeric>
+
+#include "threadpool.h"
+
+
+Scheduler::Scheduler(int threads)
+    : threads_(threads > 0 ? threads : ThreadPool::HardwareThreads())
+    , queues_()
+    , stats_()
+    , elapsed_(Clock::duration::zero())
+{
+    for (int i = 0; i < threads_; ++i)
+    {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+}
+
+int Scheduler::size() const
+{
+    return threads_;
+}
+
+void Scheduler::run(std::vector<uint64_t> const& costs, std::function<void(int, int)> const& fun)
+{
+    std::vector<int> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&costs](int a, int b)
+    {
+        return costs[a] > costs[b];
+    });
+
+    /* Each task goes to the queue with the least cost dealt so far */
+    std::vector<uint64_t> dealt(threads_, 0);
+    for (int task : order)
+    {
+        int q = std::min_element(dealt.begin(), dealt.end()) - dealt.begin();
+        dealt[q] += costs[task];
+        queues_[q]->tasks.push_back(task);
+        queues_[q]->cost += costs[task];
+    }
+
+    stats_.assign(threads_, WorkerStats());
+    Clock::time_point start = Clock::now();
+    {
+        ThreadPool pool(threads_);
+        std::vector<std::future<void>> jobs;
+        for (int w = 0; w < threads_; ++w)
+        {
+            jobs.push_back(pool.submit([this, &costs, &fun, w]()
+            {
+                WorkerStats& st = stats_[w];
+                int task;
+                while (take(costs, w, task))
+                {
+                    Clock::time_point t = Clock::now();
+                    fun(w, task);
+                    st.busy += Clock::now() - t;
+                    ++st.tasks;
+                }
+            }));
+        }
+        for (auto& job : jobs)
+        {
+            job.get();
+        }
+    }
+    elapsed_ = Clock::now() - start;
+}
+
+std::vector<Scheduler::WorkerStats> const& Scheduler::stats() const
+{
+    return stats_;
+}
+
+Scheduler::Clock::duration Scheduler::elapsed() const
+{
+    return elapsed_;
+}
+
+bool Scheduler::take(std::vector<uint64_t> const& costs, int worker, int& task)
+{
+    if (pop(*queues_[worker], costs, task))
+    {
+        return true;
+    }
+
+    /* Tasks are never added during a run: when all queues look empty,
+     * the work is done */
+    for (;;)
+    {
+        int victim = -1;
+        uint64_t most = 0;
+        for (int i = 0; i < threads_; ++i)
+        {
+            std::lock_guard<std::mutex> lock(queues_[i]->mutex);
+            if (!queues_[i]->tasks.empty() && (victim < 0 || queues_[i]->cost > most))
+            {
+                victim = i;
+                most = queues_[i]->cost;
+            }
+        }
+        if (victim < 0)
+        {
+            return false;
+        }
+        if (pop(*queues_[victim], costs, task))
+        {
+            ++stats_[worker].stolen;
+            return true;
+        }
+    }
+}
+
+bool Scheduler::pop(Queue& q, std::vector<uint64_t> const& costs, int& task)
+{
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty())
+    {
+        return false;
+    }
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    q.cost -= costs[task];
+    return true;
+}
@@ -0,0 +1,326 @@
+#include "steptrace.h"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#define TRACE_VERSION 1
+
+
+namespace
+{
+    const char     Magic[8]  = { 'G', 'M', 'S', 'D', 'C', 'T', 'R', 'C' };
+    const uint32_t ByteOrder = 0x01020304;
+
+    /* Record tags */
+    const uint8_t NodeMade    = 'N';
+    const uint8_t NodeErased  = 'E';
+    const uint8_t NodeOutputs = 'O';
+    const uint8_t StepEnd     = 'P';
+
+    /* Tree tags */
+    const uint8_t TreeRef    = 0;
+    const uint8_t TreeInline = 1;
+}
+
+
+StepTraceWriter::StepTraceWriter(std::string const& path, const GmForm* f)
+    : out_(path, std::ios::binary | std::ios::trunc)
+    , form_(f)
+    , count_(0)
+    , known_()
+    , treeOf_()
+    , erased_()
+    , written_()
+{
+    if (!out_)
+	{
+        throw std::runtime_error("Cannot write step trace " + path);
+    }
+
+    out_.write(Magic, sizeof(Magic));
+    writeU32(TRACE_VERSION);
+    writeU32(ByteOrder);
+}
+
+void StepTraceWriter::step(FlowGraph const& g, FlowGraph::Pattern p)
+{
+    const size_t count = g.nodes_.size();
+
+    /* Nodes made and dropped within the step live on in the new trees */
+    for (size_t id = count_; id < count; ++id)
+	{
+        FlowGraph::Node const& n = g.nodes_[id];
+        if (n.alive)
+		{
+            writeU8(NodeMade);
+            writeU32(id);
+            writeTree(*n.tree);
+        }
+    }
+    for (int id : erased_)
+	{
+        writeU8(NodeErased);
+        writeU32(id);
+    }
+
+    /* Every link change touches both ends */
+    written_.resize(count, 0);
+    std::vector<int> changed;
+    auto changedOutputs = [&](FlowGraph::Node const& n)
+	{
+        if (n.alive && !written_[n.id])
+		{
+            written_[n.id] = 1;
+            changed.push_back(n.id);
+            writeOutputs(n);
+        }
+    };
+    for (size_t id = count_; id < count; ++id)
+	{
+        changedOutputs(g.nodes_[id]);
+    }
+    for (const FlowGraph::Node* n : g.touched_)
+	{
+        changedOutputs(*n);
+    }
+    for (int id : changed)
+	{
+        written_[id] = 0;
+    }
+
+    writeU8(StepEnd);
+    writeU8(p == FlowGraph::Pattern::Count ? StepTraceReader::NoPattern : static_cast<int>(p));
+
+    for (int id : erased_)
+	{
+        known_.erase(treeOf_[id]);
+        treeOf_[id] = nullptr;
+    }
+    treeOf_.resize(count, nullptr);
+    for (size_t id = count_; id < count; ++id)
+	{
+        FlowGraph::Node const& n = g.nodes_[id];
+        if (n.alive)
+		{
+            known_[n.tree.get()] = id;
+            treeOf_[id] = n.tree.get();
+        }
+    }
+    erased_.clear();
+    count_ = count;
+}
+
+void StepTraceWriter::erase(FlowGraph::Node const& n)
+{
+    if (static_cast<size_t>(n.id) >= count_)
+	{
+        return;
+    }
+    erased_.push_back(n.id);
+
+    /* A tree still owned by the node is freed with it; its address may
+     * come back within the step */
+    if (n.tree)
+	{
+        known_.erase(n.tree.get());
+        treeOf_[n.id] = nullptr;
+    }
+}
+
+void StepTraceWriter::writeTree(const ControlTree& t)
+{
+    auto it = known_.find(&t);
+    if (it != known_.end())
+	{
+        writeU8(TreeRef);
+        writeU32(it->second);
+        return;
+    }
+
+    writeU8(TreeInline);
+    writeU8(static_cast<uint8_t>(t.type_));
+    writeU32(t.leaves_.size());
+    for (const auto& ptr : t.leaves_)
+	{
+        writeTree(*ptr);
+    }
+
+    if (t.type_ != ControlTree::Type::Terminal)
+	{
+        writeU32(0);
+        return;
+    }
+    writeU32(t.bb_.end() - t.bb_.begin());
+    for (auto& cmd : t.bb_)
+	{
+        std::ostringstream line;
+        if (form_)
+		{
+            cmd.print(line, *form_);
+        }
+		else
+		{
+            line << cmd.addr;
+        }
+        std::string s = line.str();
+        writeU32(s.size());
+        out_.write(s.data(), s.size());
+    }
+}
+
+void StepTraceWriter::writeOutputs(FlowGraph::Node const& n)
+{
+    writeU8(NodeOutputs);
+    writeU32(n.id);
+    writeU32(n.outputs.size());
+    for (const FlowGraph::Node* out : n.outputs)
+	{
+        writeU32(out->id);
+    }
+}
+
+void StepTraceWriter::writeU8(uint8_t v)
+{
+    out_.put(static_cast<char>(v));
+}
+
+void StepTraceWriter::writeU32(uint32_t v)
+{
+    out_.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+
+StepTraceReader::StepTraceReader(std::string const& path)
+    : file_(path)
+    , patterns_()
+{
+    char magic[8];
+    ASSERT(file_.size() >= sizeof(magic) + 2 * sizeof(uint32_t));
+    file_.read(magic, sizeof(magic));
+    ASSERT(!std::memcmp(magic, Magic, sizeof(Magic)));
+    uint32_t version = file_.read<uint32_t>();
+    uint32_t byteOrder = file_.read<uint32_t>();
+    ASSERT(version == TRACE_VERSION && byteOrder == ByteOrder);
+
+    graph_t g;
+    BinaryReader br(file_, file_.tell());
+    while (static_cast<size_t>(br.tell()) < br.size())
+	{
+        patterns_.push_back(replay(br, g));
+    }
+}
+
+int StepTraceReader::steps() const
+{
+    return patterns_.size();
+}
+
+int StepTraceReader::pattern(int step) const
+{
+    ASSERT(step >= 0 && step < steps());
+    return patterns_[step];
+}
+
+StepTraceReader::graph_t StepTraceReader::graph(int step) const
+{
+    ASSERT(step >= 0 && step < steps());
+
+    graph_t g;
+    BinaryReader br(file_, sizeof(Magic) + 2 * sizeof(uint32_t));
+    for (int i = 0; i <= step; ++i)
+	{
+        replay(br, g);
+    }
+    return g;
+}
+
+void StepTraceReader::print(std::ostream& out, const Tree& t, int depth)
+{
+    std::string pad;
+    for (int i = 0; i < depth; ++i)
+	{
+        pad += "    ";
+    }
+
+    out << pad << ControlTreeTypeToString(t.type) << " {" << std::endl;
+
+    for (const auto& ptr : t.leaves)
+	{
+        print(out, *ptr, depth + 1);
+        out << std::endl;
+    }
+    for (const auto& line : t.lines)
+	{
+        out << pad << "    " << line << std::endl;
+    }
+
+    out << pad << "}";
+}
+
+int StepTraceReader::replay(BinaryReader& br, graph_t& g) const
+{
+    for (;;)
+	{
+        uint8_t tag = br.read<uint8_t>();
+        if (tag == StepEnd)
+		{
+            return br.read<uint8_t>();
+        }
+
+        uint32_t id = br.read<uint32_t>();
+        if (tag == NodeMade)
+		{
+            auto tree = readTree(br, g);
+            if (id >= g.size())
+			{
+                g.resize(id + 1);
+            }
+            g[id].tree = std::move(tree);
+            g[id].alive = true;
+        }
+		else if (tag == NodeErased)
+		{
+            ASSERT(id < g.size());
+            g[id] = Node();
+        }
+		else if (tag == NodeOutputs)
+		{
+            ASSERT(id < g.size());
+            std::vector<uint32_t> outputs = br.readArray<uint32_t>(br.read<uint32_t>());
+            g[id].outputs.assign(outputs.begin(), outputs.end());
+        }
+		else
+		{
+            throw std::runtime_error("Bad step trace record " + std::to_string(tag));
+        }
+    }
+}
+
+std::shared_ptr<const StepTraceReader::Tree> StepTraceReader::readTree(BinaryReader& br, graph_t const& g) const
+{
+    uint8_t tag = br.read<uint8_t>();
+    if (tag == TreeRef)
+	{
+        uint32_t id = br.read<uint32_t>();
+        ASSERT(id < g.size() && g[id].alive);
+        return g[id].tree;
+    }
+    ASSERT(tag == TreeInline);
+
+    auto t = std::make_shared<Tree>();
+    t->type = static_cast<ControlTree::Type>(br.read<uint8_t>());
+    uint32_t leaves = br.read<uint32_t>();
+    for (uint32_t i = 0; i < leaves; ++i)
+	{
+        t->leaves.push_back(readTree(br, g));
+    }
+    uint32_t lines = br.read<uint32_t>();
+    for (uint32_t i = 0; i < lines; ++i)
+	{
+        uint32_t len = br.read<uint32_t>();
+        t->lines.emplace_back(br.view(br.tell(), len), len);
+        br.skip(len);
+    }
+    return t;
+}
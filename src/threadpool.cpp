@@ -0,0 +1,65 @@
+#include "threadpool.h"
+
+
+ThreadPool::ThreadPool(int threads)
+    : workers_()
+    , tasks_()
+    , mutex_()
+    , cv_()
+    , stop_(false)
+{
+    if (threads <= 0)
+    {
+        threads = HardwareThreads();
+    }
+
+    workers_.reserve(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers_.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+
+    for (std::thread& t : workers_)
+    {
+        t.join();
+    }
+}
+
+int ThreadPool::HardwareThreads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+int ThreadPool::size() const
+{
+    return workers_.size();
+}
+
+void ThreadPool::run()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty())
+            {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
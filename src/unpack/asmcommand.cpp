@@ -10,78 +10,27 @@
 
 
 const uint32_t AsmCommand::SaveStateHigh16      = 0x455f;
+const uint32_t AsmCommand::NoSymbol             = 0x00ffffff;
+
+/* Built at compile time, no static initialization order concerns */
+constexpr OpcodeTable Opcodes;
 
 AsmCommand::AsmCommand()
     : addr(-1)
-    , size(0)
     , data(0)
-    , extra{0}
+    , extra{0, 0}
 {}
 
-AsmCommand::AsmCommand(BinaryReader& br)
-    : addr(br.tell())
-    , size(4)
-    , data(br.read<uint32_t>())
-    , extra{0}
+AsmCommand::AsmCommand(int addr, const uint32_t* words, size_t avail)
+    : addr(addr)
+    , data(words[0])
+    , extra{0, 0}
 {
-    switch (operation())
+    size_t n = size() / sizeof(uint32_t);
+    ASSERT(avail >= n);
+    for (size_t i = 1; i < n; ++i)
 	{
-
-        /* TODO */
-        case (Operation::Cmp):
-        case (Operation::Conv):
-        case (Operation::Mul):
-        case (Operation::Div):
-        case (Operation::Add):
-        case (Operation::Sub):
-        case (Operation::And):
-        case (Operation::Or):
-        case (Operation::Xor):
-        case (Operation::Rem):
-        case (Operation::Mod):
-        case (Operation::Neg):
-        case (Operation::Not):
-        case (Operation::Shl):
-        case (Operation::Shr):
-        case (Operation::Ret):
-        case (Operation::Exit):
-        case (Operation::Pop):
-        case (Operation::Jmp):
-        case (Operation::JZ):
-        case (Operation::JNZ):
-        case (Operation::PushEnv):
-        case (Operation::PopEnv):
-        case (Operation::Break):
-        case (Operation::Dup):
-            break;
-
-        /* Do nothing */
-        case (Operation::PushI16):
-            break;
-
-        /* Push */
-        case (Operation::PushCst):
-        case (Operation::PushLoc):
-        case (Operation::PushGlb):
-        case (Operation::PushVar):
-        case (Operation::Call):
-        case (Operation::Set):
-            if (dataType() != DataType::Int16)
-			{
-                size += 4;
-                extra[0] = br.read<uint32_t>();
-                if (dataType() == DataType::Double || dataType() == DataType::Int64)
-				{
-                    size += 4;
-                    extra[1] = br.read<uint32_t>();
-                }
-            }
-            break;
-
-        /* Error */
-        case (Operation::Nop):
-        case (Operation::Save):
-            break;
+        extra[i - 1] = words[i];
     }
 
     if (data >> 16 == SaveStateHigh16)
@@ -90,6 +39,15 @@ AsmCommand::AsmCommand(BinaryReader& br)
     }
 }
 
+int AsmCommand::size() const
+{
+    if (Opcodes[operation()].operand == OperandRule::None)
+	{
+        return 4;
+    }
+    return 4 + Opcodes[dataType()].operandSize;
+}
+
 TypePair::TypePair()
     : pair_(0)
 {}
@@ -112,123 +70,33 @@ std::vector<AsmCommand> Disassemble(BinaryReader& br, uint32_t past_the_end)
 {
     std::vector<AsmCommand> out;
 
-    while (br.tell() < past_the_end)
+    int base = br.tell();
+    if (past_the_end <= static_cast<uint32_t>(base))
 	{
-        AsmCommand current(br);
-        out.push_back(current);
+        return out;
     }
 
-    return std::move(out);
-}
-
-const char* Operation2String(Operation op)
-{
-    static char tmp[64];
+    /* Whole code range is fetched at once, then decoded from memory */
+    std::vector<uint32_t> words = br.readArray<uint32_t>((past_the_end - base + 3) / 4);
+    out.reserve(words.size());
 
-    switch (op)
+    for (size_t i = 0; i < words.size();)
 	{
-		CASE_RETURN_SCOPED(Operation, Nop)
-		CASE_RETURN_SCOPED(Operation, Conv)
-		CASE_RETURN_SCOPED(Operation, Mul)
-		CASE_RETURN_SCOPED(Operation, Div)
-		CASE_RETURN_SCOPED(Operation, Rem)
-		CASE_RETURN_SCOPED(Operation, Mod)
-		CASE_RETURN_SCOPED(Operation, Add)
-		CASE_RETURN_SCOPED(Operation, Sub)
-		CASE_RETURN_SCOPED(Operation, And)
-		CASE_RETURN_SCOPED(Operation, Or)
-		CASE_RETURN_SCOPED(Operation, Xor)
-		CASE_RETURN_SCOPED(Operation, Neg)
-		CASE_RETURN_SCOPED(Operation, Not)
-		CASE_RETURN_SCOPED(Operation, Shl)
-		CASE_RETURN_SCOPED(Operation, Shr)
-		CASE_RETURN_SCOPED(Operation, Cmp)
-		CASE_RETURN_SCOPED(Operation, Set)
-		CASE_RETURN_SCOPED(Operation, Dup)
-		CASE_RETURN_SCOPED(Operation, Ret)
-		CASE_RETURN_SCOPED(Operation, Exit)
-		CASE_RETURN_SCOPED(Operation, Pop)
-		CASE_RETURN_SCOPED(Operation, Jmp)
-		CASE_RETURN_SCOPED(Operation, JZ)
-		CASE_RETURN_SCOPED(Operation, JNZ)
-		CASE_RETURN_SCOPED(Operation, PushEnv)
-		CASE_RETURN_SCOPED(Operation, PopEnv)
-		CASE_RETURN_SCOPED(Operation, PushCst)
-		CASE_RETURN_SCOPED(Operation, PushLoc)
-		CASE_RETURN_SCOPED(Operation, PushGlb)
-		CASE_RETURN_SCOPED(Operation, PushVar)
-		CASE_RETURN_SCOPED(Operation, PushI16)
-		CASE_RETURN_SCOPED(Operation, Call)
-		CASE_RETURN_SCOPED(Operation, Break)
-		CASE_RETURN_SCOPED(Operation, Save)
+        out.emplace_back(base + static_cast<int>(i * 4), &words[i], words.size() - i);
+        i += out.back().size() / 4;
     }
 
-    sprintf(tmp, "<%x>", static_cast<unsigned>(op));
-    return tmp;
+    return std::move(out);
 }
 
-std::string Operation2PrettyString(Operation op)
+const char* Operation2String(Operation op)
 {
-    switch (op)
-	{
-        case (Operation::Add):
-        case (Operation::And):
-        case (Operation::Call):
-        case (Operation::Cmp):
-        case (Operation::Conv):
-        case (Operation::Div):
-        case (Operation::Dup):
-        case (Operation::Exit):
-        case (Operation::Jmp):
-        case (Operation::JNZ):
-        case (Operation::JZ):
-        case (Operation::Mod):
-        case (Operation::Mul):
-        case (Operation::Neg):
-        case (Operation::Nop):
-        case (Operation::Not):
-        case (Operation::Or):
-        case (Operation::Pop):
-        case (Operation::Rem):
-        case (Operation::Ret):
-        case (Operation::Shl):
-        case (Operation::Shr):
-        case (Operation::Sub):
-        case (Operation::Set):
-        case (Operation::Xor):
-        case (Operation::Save):
-        case (Operation::Break):
-			{
-                std::string ret(Operation2String(op));
-                string_lower(ret);
-                return ret;
-            }
-            break;
-
-        case (Operation::PopEnv):
-            return "pop.env";
-
-        case (Operation::PushCst):
-            return "push.const";
-
-        case (Operation::PushEnv):
-            return "push.env";
-
-        case (Operation::PushGlb):
-            return "push.glob";
-
-        case (Operation::PushI16):
-            return "push.int16";
-
-        case (Operation::PushLoc):
-            return "push.local";
-
-        case (Operation::PushVar):
-            return "push.var";
-
-    }
+    return Opcodes[op].name;
+}
 
-    return "#ERR";
+const char* Operation2PrettyString(Operation op)
+{
+    return Opcodes[op].pretty;
 }
 
 const char* Comparison2String(Comparison c)
@@ -253,36 +121,16 @@ const char* Comparison2String(Comparison c)
 
 const char* DataType2String(DataType t)
 {
-    switch (t)
-	{
-		CASE_RETURN_SCOPED(DataType, Double);
-		CASE_RETURN_SCOPED(DataType, Float);
-		CASE_RETURN_SCOPED(DataType, Int16);
-		CASE_RETURN_SCOPED(DataType, Int32);
-		CASE_RETURN_SCOPED(DataType, Int64);
-		CASE_RETURN_SCOPED(DataType, Bool);
-		CASE_RETURN_SCOPED(DataType, Variable);
-		CASE_RETURN_SCOPED(DataType, String);
-		CASE_RETURN_SCOPED(DataType, Instance);
-    }
-    return "???";
+    return Opcodes[t].name;
 }
 
-std::string DataType2PrettyString(DataType t)
+const char* DataType2PrettyString(DataType t)
 {
-    if (t == DataType::Variable)
-	{
-        return "var";
-    }
-
-    std::string ret(DataType2String(t));
-    string_lower(ret);
-    return ret;
+    return Opcodes[t].pretty;
 }
 
 const char* InstanceType2String(InstanceType t)
 {
-    static char tmp[32];
     switch (t)
 	{
 		CASE_RETURN_SCOPED(InstanceType, StackTopOrGlobal);
@@ -294,34 +142,40 @@ const char* InstanceType2String(InstanceType t)
 		CASE_RETURN_SCOPED(InstanceType, Unknown1);
 		CASE_RETURN_SCOPED(InstanceType, Local);
     }
-    sprintf(tmp, "inst_%d", (int)t);
-    return tmp;
+    return nullptr;
 }
 
-std::string InstanceType2PrettyString(InstanceType t)
+const char* InstanceType2PrettyString(InstanceType t)
 {
     switch (t)
 	{
         case (InstanceType::All):
+            return "all";
         case (InstanceType::Self):
+            return "self";
         case (InstanceType::Other):
+            return "other";
         case (InstanceType::Noone):
+            return "noone";
         case (InstanceType::Global):
+            return "global";
         case (InstanceType::Local):
-			{
-                std::string ret(InstanceType2String(t));
-                string_lower(ret);
-                return ret;
-            }
-            break;
-
+            return "local";
         case (InstanceType::StackTopOrGlobal):
             return "stog";
-
         case (InstanceType::Unknown1):
             return "UNKNOWN";
     }
-    return std::to_string((int)t);
+    return nullptr;
+}
+
+std::ostream& operator<< (std::ostream& out, InstanceType t)
+{
+    if (const char* name = InstanceType2PrettyString(t))
+	{
+        return out << name;
+    }
+    return out << static_cast<int>(t);
 }
 
 Operation AsmCommand::operation() const
@@ -396,7 +250,7 @@ std::ostream& operator<< (std::ostream& out, const TypePair& p)
 
 std::ostream& operator<< (std::ostream& out, const ScopedVariable& var)
 {
-    out << InstanceType2PrettyString(var.scope) << "." << var.nameIndex;
+    out << var.scope << "." << var.nameIndex;
     var.printVarType(out);
     return out;
 }
@@ -408,24 +262,52 @@ int32_t AsmCommand::jumpAddr() const
 
 bool OperationIsPush(Operation op)
 {
-    return
-        op == Operation::PushCst ||
-        op == Operation::PushGlb ||
-        op == Operation::PushI16 ||
-        op == Operation::PushLoc ||
-        op == Operation::PushVar;
+    return Opcodes[op].cls == OpClass::Push;
+}
+
+bool OperationIsJump(Operation op)
+{
+    return Opcodes[op].cls == OpClass::Jump || Opcodes[op].cls == OpClass::CondJump;
+}
+
+bool AsmCommand::refersVariable() const
+{
+    return size() > 4
+           && (operation() == Operation::Set
+               || (OperationIsPush(operation()) && dataType() == DataType::Variable));
+}
+
+uint32_t AsmCommand::symbolIndex() const
+{
+    if (operation() == Operation::Call)
+	{
+        return extra[0];
+    }
+    return extra[0] & 0x00ffffff;
+}
+
+bool AsmCommand::hasSymbol() const
+{
+    return (operation() == Operation::Call || refersVariable())
+           && symbolIndex() != NoSymbol;
 }
 
-std::string const& AsmCommand::toString() const
+void AsmCommand::symbolIndex(uint32_t idx)
 {
-    return text;
+    if (operation() == Operation::Call)
+	{
+        extra[0] = idx;
+    }
+	else
+	{
+        extra[0] = (extra[0] & 0xff000000) | (idx & 0x00ffffff);
+    }
 }
 
-void AsmCommand::initText(const GmForm* f)
+void AsmCommand::print(std::ostream& out, const GmForm& f) const
 {
     char tmp[16];
     sprintf(tmp, "0x%08x", addr);
-    std::ostringstream out;
     out << tmp << ": " << Operation2PrettyString(operation()) << " ";
 
     switch (operation())
@@ -464,9 +346,9 @@ void AsmCommand::initText(const GmForm* f)
                 }
                 else
                 {
-                    out << InstanceType2PrettyString(variable().scope);
+                    out << variable().scope;
                 }
-                out << "." << symbol;
+                out << "." << f.symbolName(*this);
                 variable().printVarType(out);
             }
             break;
@@ -496,7 +378,7 @@ void AsmCommand::initText(const GmForm* f)
                     break;
 
                 case (DataType::String):
-                    out << '"' << f->strings().get(dataInt32()) << '"';
+                    out << '"' << f.strings().get(dataInt32()) << '"';
                     break;
 
                 case (DataType::Int32):
@@ -506,7 +388,7 @@ void AsmCommand::initText(const GmForm* f)
                     break;
 
                 case (DataType::Variable):
-                    out << InstanceType2PrettyString(variable().scope) << "." << symbol;
+                    out << variable().scope << "." << f.symbolName(*this);
                     variable().printVarType(out);
                     break;
             }
@@ -534,7 +416,7 @@ void AsmCommand::initText(const GmForm* f)
             break;
 
         case (Operation::Call):
-            out << symbol << "[" << dataInt16() << "]";
+            out << f.symbolName(*this) << "[" << dataInt16() << "]";
             break;
 
         case (Operation::Jmp):
@@ -544,8 +426,6 @@ void AsmCommand::initText(const GmForm* f)
             out << tmp;
             break;
     }
-
-    text = std::move(out.str());
 }
 
 void ScopedVariable::printVarType(std::ostream& out) const
@@ -2,13 +2,152 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+
+#ifdef __WINNT
+#include "windows.h"
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 BinaryReader::BinaryReader(std::istream& is)
     : buf_()
+    , data_(nullptr)
+    , size_(0)
     , ptr_(0)
+    , mapping_(nullptr)
 {
     buf_.reserve(64 * 1024);
     std::copy(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>(), std::back_inserter(buf_));
+    data_ = buf_.data();
+    size_ = buf_.size();
+}
+
+BinaryReader::BinaryReader(const BinaryReader& source, int pos)
+    : buf_()
+    , data_(source.data_)
+    , size_(source.size_)
+    , ptr_(pos)
+    , mapping_(nullptr)
+{}
+
+#ifdef __WINNT
+
+BinaryReader::BinaryReader(const std::string& path)
+    : buf_()
+    , data_(nullptr)
+    , size_(0)
+    , ptr_(0)
+    , mapping_(nullptr)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+	{
+        throw std::runtime_error("Cannot open file " + path);
+    }
+
+    LARGE_INTEGER fsize;
+    GetFileSizeEx(file, &fsize);
+    size_ = static_cast<size_t>(fsize.QuadPart);
+
+    if (size_)
+    {
+        mapping_ = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_)
+        {
+            data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+    CloseHandle(file);
+
+    if (size_ && !data_)
+	{
+        unmap();
+        throw std::runtime_error("Cannot map file " + path);
+    }
+}
+
+bool BinaryReader::IsMappable(const std::string& path)
+{
+    DWORD attr = GetFileAttributesA(path.c_str());
+    return attr != INVALID_FILE_ATTRIBUTES && !(attr & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+void BinaryReader::unmap()
+{
+    if (data_ && mapping_)
+    {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_)
+    {
+        CloseHandle(mapping_);
+    }
+    mapping_ = nullptr;
+}
+
+#else
+
+BinaryReader::BinaryReader(const std::string& path)
+    : buf_()
+    , data_(nullptr)
+    , size_(0)
+    , ptr_(0)
+    , mapping_(nullptr)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+	{
+        throw std::runtime_error("Cannot open file " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st))
+	{
+        close(fd);
+        throw std::runtime_error("Cannot stat file " + path);
+    }
+    size_ = st.st_size;
+
+    if (size_)
+    {
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+		{
+            close(fd);
+            throw std::runtime_error("Cannot map file " + path);
+        }
+        madvise(p, size_, MADV_WILLNEED);
+        mapping_ = p;
+        data_ = static_cast<const char*>(p);
+    }
+    close(fd);
+}
+
+bool BinaryReader::IsMappable(const std::string& path)
+{
+    struct stat st;
+    return !stat(path.c_str(), &st) && S_ISREG(st.st_mode);
+}
+
+void BinaryReader::unmap()
+{
+    if (mapping_)
+    {
+        munmap(mapping_, size_);
+    }
+    mapping_ = nullptr;
+}
+
+#endif
+
+BinaryReader::~BinaryReader()
+{
+    unmap();
 }
 
 void BinaryReader::skip(int n)
@@ -23,22 +162,36 @@ void BinaryReader::seek(int p)
 
 int BinaryReader::read(char* o, int n)
 {
-    int i = 0;
-    while (n--)
-    {
-        *o++ = read<char>();
-        ++i;
-    }
-    return i;
+    read<char>(o, n);
+    return n > 0 ? n : 0;
 }
 
 std::string BinaryReader::readStringPtr()
 {
-    uint32_t off = read<uint32_t>();
-    std::string ret(&buf_.at(off));
+    return stringAt(read<uint32_t>());
+}
+
+std::string BinaryReader::stringAt(uint32_t off) const
+{
+    if (off >= size_)
+	{
+        throw std::out_of_range("String pointer out of range");
+    }
+    std::string ret(data_ + off, strnlen(data_ + off, size_ - off));
     return std::move(ret);
 }
 
+const char* BinaryReader::view(size_t pos, size_t n) const
+{
+    ASSERT(pos <= size_ && n <= size_ - pos);
+    return data_ + pos;
+}
+
+size_t BinaryReader::size() const
+{
+    return size_;
+}
+
 int BinaryReader::tell()
 {
     return ptr_;
@@ -1,37 +1,83 @@
 #include "gmform/16/gmform16.h"
 #include "binaryreader.h"
+#include "threadpool.h"
+#include "gmcache.h"
 
-GmForm16::GmForm16(BinaryReader& br)
-    : header_(br)
-    , general_(br)
-    , options_(br)
-    , language_(br)
-    , extensions_(br)
-    , sounds_(br)
-    , audioGroup_(br)
-    , sprites_(br)
-    , backgrounds_(br)
-    , paths_(br)
-    , scripts_(br)
-    , globals_(br)
-    , shaders_(br)
-    , fonts_(br)
-    , timelines_(br)
-    , objects_(br)
-    , rooms_(br)
-    , datafiles_(br)
-    , texturePages_(br)
-    , code_(br)
-    , variables_(br)
-    , functions_(br)
-    , strings_(br)
-    , textures_(br)
-    , audio_(br)
-{
-    functions_.postInit(*this);
-    variables_.postInit(*this);
-    code_.postInit(*this);
-}
+GmForm16::GmForm16(BinaryReader& br, std::string const& cachePath)
+    : br_(br)
+    , header_(br)
+    , directory_(br, header_)
+    , cachePath_(cachePath)
+    , codeReady_(false)
+{}
 
 GmForm16::~GmForm16()
 {}
+
+GmCodeChunk& GmForm16::loadCode() const
+{
+    if (!codeReady_)
+    {
+        load(code_, SectionHeader::Code);
+
+        uint64_t key = cachePath_.empty() ? 0 : GmCache::Key(br_, directory_);
+        if (auto cache = GmCache::Open(cachePath_, key))
+        {
+            code_->restore(std::move(cache));
+        }
+        else
+        {
+            load(functions_, SectionHeader::Functions).postInit(*code_);
+            load(variables_, SectionHeader::Variables).postInit(*code_);
+
+            if (!cachePath_.empty())
+            {
+                GmCache::Write(cachePath_, key, *code_);
+            }
+        }
+        codeReady_ = true;
+    }
+    return *code_;
+}
+
+void GmForm16::preload(int threads, bool withResources)
+{
+    std::vector<std::future<void>> jobs;
+    ThreadPool pool(threads);
+
+    auto submit = [&](auto& slot, SectionHeader hdr)
+    {
+        if (!slot && directory_.contains(hdr))
+        {
+            jobs.push_back(pool.submit([this, &slot, hdr]() { load(slot, hdr); }));
+        }
+    };
+
+    /* Chunk constructors are independent of each other */
+    submit(code_, SectionHeader::Code);
+    submit(functions_, SectionHeader::Functions);
+    submit(variables_, SectionHeader::Variables);
+    submit(strings_, SectionHeader::Strings);
+
+    if (withResources)
+    {
+        submit(sprites_, SectionHeader::Sprites);
+        submit(sounds_, SectionHeader::Sounds);
+        submit(backgrounds_, SectionHeader::Backgrounds);
+        submit(paths_, SectionHeader::Paths);
+        submit(scripts_, SectionHeader::Scripts);
+        submit(shaders_, SectionHeader::Shaders);
+        submit(fonts_, SectionHeader::Fonts);
+        submit(timelines_, SectionHeader::Timelines);
+        submit(objects_, SectionHeader::Objects);
+        submit(rooms_, SectionHeader::Rooms);
+    }
+
+    for (auto& job : jobs)
+    {
+        job.get();
+    }
+
+    /* postInit steps depend on CODE, FUNC and VARI */
+    loadCode();
+}
@@ -0,0 +1,187 @@
+#include "gmcache.h"
+
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <cstddef>
+#include <cstring>
+
+#include "fsmanager.h"
+#include "utils.h"
+
+#define CACHE_VERSION 2
+
+
+namespace
+{
+    const char     Magic[8]  = { 'G', 'M', 'S', 'D', 'C', 'C', 'H', 'E' };
+    const uint32_t ByteOrder = 0x01020304;
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    template<class T>
+    void writeRaw(std::ostream& out, const T* data, size_t n)
+    {
+        out.write(reinterpret_cast<const char*>(data), sizeof(T) * n);
+    }
+}
+
+
+uint64_t GmCache::Key(BinaryReader const& br, GmChunkDirectory const& dir)
+{
+    uint64_t total = br.size();
+    uint64_t h = hash_bytes(&total, sizeof(total));
+
+    /* Cached data is derived from these chunks only */
+    for (SectionHeader hdr : { SectionHeader::Code, SectionHeader::Functions, SectionHeader::Variables })
+    {
+        if (dir.contains(hdr))
+        {
+            GmChunkDirectory::Entry const& e = dir.at(hdr);
+            h = hash_bytes(br.view(e.start, e.size), e.size, h);
+        }
+    }
+    return h;
+}
+
+std::shared_ptr<const GmCache> GmCache::Open(std::string const& path, uint64_t key)
+{
+    if (path.empty() || !BinaryReader::IsMappable(path))
+    {
+        return nullptr;
+    }
+
+    try
+    {
+        auto cache = std::make_shared<const GmCache>(path);
+        if (cache->header_.key == key)
+        {
+            return cache;
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::clog << "Ignoring cache " << path << ": " << e.what() << std::endl;
+    }
+    return nullptr;
+}
+
+void GmCache::Write(std::string const& path, uint64_t key, GmCodeChunk const& code)
+{
+    /* Other processes may have the cache mapped: truncating it under them
+     * would fault their reads, so a new file replaces it instead */
+    const std::string tmpPath = path + "." + to_string(std::random_device()())
+        + "-" + to_string(Clock::now().time_since_epoch().count()) + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("Cannot write cache " + tmpPath);
+    }
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version      = CACHE_VERSION;
+    header.byteOrder    = ByteOrder;
+    header.key          = 0;
+    header.scriptCount  = code.count();
+    header.symbolCount  = code.symbols().size();
+    header.commandCount = 0;
+    header.reserved     = 0;
+
+    std::vector<uint32_t> first;
+    first.reserve(code.count() + 1);
+    for (ScriptEntry const& scr : code)
+    {
+        first.push_back(header.commandCount);
+        header.commandCount += scr.code().size();
+    }
+    first.push_back(header.commandCount);
+
+    std::vector<uint32_t> symbols;
+    symbols.reserve(code.symbols().size() * 2);
+    for (auto& ref : code.symbols())
+    {
+        symbols.push_back(ref.first);
+        symbols.push_back(ref.second);
+    }
+
+    writeRaw(out, &header, 1);
+    writeRaw(out, first.data(), first.size());
+    writeRaw(out, symbols.data(), symbols.size());
+    for (ScriptEntry const& scr : code)
+    {
+        writeRaw(out, scr.code().data(), scr.code().size());
+    }
+
+    /* Key goes in last, an interrupted write never matches */
+    out.seekp(offsetof(Header, key));
+    writeRaw(out, &key, 1);
+
+    out.close();
+    if (!out)
+    {
+        FsManager::fileDelete(wide(tmpPath));
+        throw std::runtime_error("Cannot write cache " + tmpPath);
+    }
+    FsManager::fileReplace(wide(tmpPath), wide(path));
+}
+
+GmCache::GmCache(std::string const& path)
+    : file_(path)
+{
+    std::memcpy(&header_, file_.view(0, sizeof(Header)), sizeof(Header));
+
+    ASSERT(!std::memcmp(header_.magic, Magic, sizeof(Magic)));
+    ASSERT(header_.version == CACHE_VERSION && header_.byteOrder == ByteOrder);
+
+    /* Validates section bounds */
+    file_.view(commandsPos(), sizeof(AsmCommand) * header_.commandCount);
+}
+
+int GmCache::scriptCount() const
+{
+    return header_.scriptCount;
+}
+
+GmCodeChunk::symbol_refs_t GmCache::symbols() const
+{
+    std::vector<uint32_t> raw(header_.symbolCount * 2);
+    std::memcpy(raw.data(), file_.view(symbolsPos(), raw.size() * sizeof(uint32_t)), raw.size() * sizeof(uint32_t));
+
+    GmCodeChunk::symbol_refs_t ret;
+    ret.reserve(header_.symbolCount);
+    for (size_t i = 0; i < raw.size(); i += 2)
+    {
+        ret.emplace_back(raw[i], raw[i + 1]);
+    }
+    return ret;
+}
+
+std::vector<AsmCommand> GmCache::commands(int script) const
+{
+    ASSERT(script >= 0 && static_cast<uint32_t>(script) < header_.scriptCount);
+
+    uint32_t range[2];
+    std::memcpy(range, file_.view(scriptsPos() + script * sizeof(uint32_t), sizeof(range)), sizeof(range));
+    ASSERT(range[0] <= range[1] && range[1] <= header_.commandCount);
+
+    std::vector<AsmCommand> ret(range[1] - range[0]);
+    size_t bytes = ret.size() * sizeof(AsmCommand);
+    std::memcpy(ret.data(), file_.view(commandsPos() + range[0] * sizeof(AsmCommand), bytes), bytes);
+    return ret;
+}
+
+size_t GmCache::scriptsPos() const
+{
+    return sizeof(Header);
+}
+
+size_t GmCache::symbolsPos() const
+{
+    return scriptsPos() + (header_.scriptCount + 1) * sizeof(uint32_t);
+}
+
+size_t GmCache::commandsPos() const
+{
+    return symbolsPos() + header_.symbolCount * 2 * sizeof(uint32_t);
+}
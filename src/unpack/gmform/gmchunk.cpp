@@ -1,6 +1,9 @@
 #include "gmchunk.h"
 
+#include <algorithm>
+
 #include "gmform.h"
+#include "gmcache.h"
 
 #define UNREFERENCED_PARAMETER(_x) (void)_x;
 #define TO_CSTR(_ptr) ((const char*)(_ptr))
@@ -22,7 +25,7 @@ GmChunk::GmChunk(BinaryReader& br, SectionHeader hdr)
     , size(header.size + HEADER_SIZE)
 {
     ASSERT(header.nameCode == static_cast<uint32_t>(hdr));
-    std::cout << header.nameString << " " << size << "\n";
+    std::cout << header.nameString + " " + std::to_string(size) + "\n";
 }
 
 
@@ -164,34 +167,98 @@ GmTpagChunk::GmTpagChunk(BinaryReader& br)
 
 GmCodeChunk::GmCodeChunk(BinaryReader& br)
     : GmListChunk<ScriptEntry>(br, SectionHeader::Code)
+    , reader_(br, 0)
+    , codeBegin_(pastTheEndAddr())
+    , codeEnd_(start)
 {
+    for (int i = 0; i < count(); ++i)
+	{
+        ScriptEntry& scr = content[i];
+        scr.owner_ = this;
+        scr.index_ = i;
+        codeBegin_ = std::min<int>(codeBegin_, scr.codeOffset);
+        codeEnd_   = std::max<int>(codeEnd_, scr.codeOffset + scr.codeSize);
+    }
+
     br.seek(pastTheEndAddr());
 }
 
-AsmCommand* GmCodeChunk::at(int off)
+bool GmCodeChunk::peek(int addr, AsmCommand& out) const
+{
+    if (addr < codeBegin_ || addr >= codeEnd_ || addr % 4)
+	{
+        return false;
+    }
+
+    uint32_t words[3];
+    size_t avail = std::min<size_t>(3, (codeEnd_ - addr) / 4);
+
+    BinaryReader cursor(reader_, addr);
+    cursor.read<uint32_t>(words, avail);
+
+    out = AsmCommand(addr, words, avail);
+    return true;
+}
+
+void GmCodeChunk::bindSymbols(symbol_refs_t const& refs)
 {
-    for (ScriptEntry& scr : content)
+    symbols_.insert(symbols_.end(), refs.begin(), refs.end());
+
+    std::stable_sort(symbols_.begin(), symbols_.end(), [](auto& a, auto& b)
+	{
+        return a.first < b.first;
+    });
+
+    /* Later references to the same address win */
+    symbol_refs_t merged;
+    merged.reserve(symbols_.size());
+    for (auto& ref : symbols_)
 	{
-	    if (scr.codeOffset + scr.codeSize < off) { continue; }
-        auto it = std::find_if(scr.begin(), scr.end(), [off](auto & cmd)
+        if (!merged.empty() && merged.back().first == ref.first)
 		{
-            return cmd.addr == off;
-        });
-        if (it != scr.end())
+            merged.back() = ref;
+        }
+        else
 		{
-            return &*it;
+            merged.push_back(ref);
         }
     }
-    return nullptr;
+    symbols_.swap(merged);
+}
+
+void GmCodeChunk::restore(std::shared_ptr<const GmCache> cache)
+{
+    ASSERT(cache->scriptCount() == count());
+    symbols_ = cache->symbols();
+    cache_ = std::move(cache);
 }
 
-void GmCodeChunk::postInit(GmForm& f)
+void GmCodeChunk::disassemble(ScriptEntry const& scr) const
 {
-    for (ScriptEntry& scr : content)
+    if (cache_)
+	{
+        scr.code_ = cache_->commands(scr.index_);
+        return;
+    }
+
+    BinaryReader cursor(reader_, scr.codeOffset);
+    scr.code_ = Disassemble(cursor, scr.codeOffset + scr.codeSize);
+
+    auto it = symbols_.begin();
+    for (AsmCommand& cmd : scr.code_)
 	{
-        for (AsmCommand& cmd : scr)
+        it = std::lower_bound(it, symbols_.end(), cmd.addr, [](auto& ref, int a)
 		{
-            cmd.initText(&f);
+            return ref.first < a;
+        });
+
+        if (it != symbols_.end() && it->first == cmd.addr)
+		{
+            cmd.symbolIndex(it->second);
+        }
+        else if (cmd.operation() == Operation::Call || cmd.refersVariable())
+		{
+            cmd.symbolIndex(AsmCommand::NoSymbol);
         }
     }
 }
@@ -203,11 +270,14 @@ GmVariChunk::GmVariChunk(BinaryReader& br)
     br.skip(unknown);
 
     int count = (size - HEADER_SIZE - unknown) / VariableDefEntry::static_size;
+    const int stride = VariableDefEntry::static_size / sizeof(uint32_t);
+
+    std::vector<uint32_t> raw = br.readArray<uint32_t>(count * stride);
 
     refVar.reserve(count);
     for (int i = 0; i < count; ++i)
 	{
-        refVar.push_back(VariableDefEntry(br));
+        refVar.push_back(VariableDefEntry(br, &raw[i * stride]));
     }
 
     br.seek(pastTheEndAddr());
@@ -218,11 +288,14 @@ GmFuncChunk::GmFuncChunk(BinaryReader& br)
 {
     /* Function definitions */
     uint32_t funcCount = br.read<uint32_t>();
+    const int stride = FunctionDefEntry::static_size / sizeof(uint32_t);
+
+    std::vector<uint32_t> raw = br.readArray<uint32_t>(funcCount * stride);
 
     refFunc.reserve(funcCount);
     for (size_t i = 0; i < funcCount; ++i)
 	{
-        refFunc.push_back(FunctionDefEntry(br));
+        refFunc.push_back(FunctionDefEntry(br, &raw[i * stride]));
     }
 
     /* Scripts and locals */
@@ -237,24 +310,25 @@ GmFuncChunk::GmFuncChunk(BinaryReader& br)
     br.seek(pastTheEndAddr());
 }
 
-void GmFuncChunk::postInit(GmForm& f)
+void GmFuncChunk::postInit(GmCodeChunk& code)
 {
+    GmCodeChunk::symbol_refs_t resolved;
+
     for (size_t i = 0; i < refFunc.size(); ++i)
 	{
         FunctionDefEntry& rf = refFunc[i];
         int entry = rf.firstOccurrence;
+        AsmCommand cmd;
 
         for (size_t ec = 0; ec < rf.occurrenceCount; ++ec)
 		{
-            AsmCommand* cmd = f.code().at(entry);
-
-            if (!cmd || cmd->operation() != Operation::Call)
+            if (!code.peek(entry, cmd) || cmd.operation() != Operation::Call)
 			{
                 break;
             }
 
-            cmd->symbol = rf.name;
-            int shift = cmd->dataInt32();
+            resolved.emplace_back(entry, i);
+            int shift = cmd.dataInt32();
             entry += shift;
             if (!shift)
 			{
@@ -262,24 +336,28 @@ void GmFuncChunk::postInit(GmForm& f)
             }
         }
     }
+
+    code.bindSymbols(resolved);
 }
 
-void GmVariChunk::postInit(GmForm& f)
+void GmVariChunk::postInit(GmCodeChunk& code)
 {
+    GmCodeChunk::symbol_refs_t resolved;
+
     for (size_t i = 0; i < refVar.size(); ++i)
 	{
         VariableDefEntry& rv = refVar[i];
         int entry = rv.firstOccurrence;
+        AsmCommand cmd;
 
         for (size_t ec = 0; ec < rv.occurrenceCount; ++ec)
 		{
-            AsmCommand* cmd = f.code().at(entry);
+            bool found = code.peek(entry, cmd);
 
-            ASSERT(cmd && (OperationIsPush(cmd->operation()) || cmd->operation() == Operation::Set));
-            ASSERT(cmd->symbol.empty());
+            ASSERT(found && (OperationIsPush(cmd.operation()) || cmd.operation() == Operation::Set));
 
-            cmd->symbol = rv.name;
-            int shift = cmd->variable().nameIndex;
+            resolved.emplace_back(entry, i);
+            int shift = cmd.variable().nameIndex;
             entry += shift;
 
             if (!shift)
@@ -289,6 +367,16 @@ void GmVariChunk::postInit(GmForm& f)
             }
         }
     }
+
+    /* Every instruction belongs to at most one chain */
+    GmCodeChunk::symbol_refs_t sorted(resolved);
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT(std::adjacent_find(sorted.begin(), sorted.end(), [](auto& a, auto& b)
+	{
+        return a.first == b.first;
+    }) == sorted.end());
+
+    code.bindSymbols(resolved);
 }
 
 GmStrgChunk::GmStrgChunk(BinaryReader& br)
@@ -368,24 +456,36 @@ ScriptDefEntry::ScriptDefEntry(BinaryReader& br)
 }
 
 ScriptEntry::ScriptEntry(BinaryReader& br)
+    : owner_(nullptr)
+    , index_(-1)
+    , code_()
+    , decoded_(false)
 {
     name           = br.readStringPtr();
     codeSize       = br.read<int32_t>();
     br.skip(4);
     int32_t shift  = br.read<int32_t>();
     codeOffset     = br.tell() + shift - 4;
+}
 
-    br.seek(codeOffset);
-    code = Disassemble(br, codeOffset + codeSize);
+ScriptEntry::v_code_t const& ScriptEntry::code() const
+{
+    if (!decoded_)
+	{
+        ASSERT(owner_);
+        owner_->disassemble(*this);
+        decoded_ = true;
+    }
+    return code_;
 }
 
-std::ostream& operator<< (std::ostream& out, const ScriptEntry& s)
+void ScriptEntry::print(std::ostream& out, GmForm const& f) const
 {
-    for (const AsmCommand& cmd : s.code)
+    for (const AsmCommand& cmd : code())
 	{
-        out << cmd.toString() << std::endl;
+        cmd.print(out, f);
+        out << std::endl;
     }
-    return out;
 }
 
 GlobalvarEntry::GlobalvarEntry(BinaryReader& br)
@@ -438,11 +538,11 @@ TimelineEntry::TimelineEntry(BinaryReader& br)
     name = br.readStringPtr();
 }
 
-FunctionDefEntry::FunctionDefEntry(BinaryReader& br)
+FunctionDefEntry::FunctionDefEntry(const BinaryReader& br, const uint32_t* raw)
 {
-    name = br.readStringPtr();
-    occurrenceCount = br.read<uint32_t>();
-    firstOccurrence = br.read<uint32_t>();
+    name = br.stringAt(raw[0]);
+    occurrenceCount = raw[1];
+    firstOccurrence = raw[2];
 }
 
 FontEntry::FontEntry(BinaryReader& br)
@@ -450,18 +550,17 @@ FontEntry::FontEntry(BinaryReader& br)
     name = br.readStringPtr();
 }
 
-VariableDefEntry::VariableDefEntry(BinaryReader& br)
+VariableDefEntry::VariableDefEntry(const BinaryReader& br, const uint32_t* raw)
 {
-    name = br.readStringPtr();
-    br.skip(8);
-    occurrenceCount = br.read<int32_t>();
-    firstOccurrence = br.read<int32_t>();
+    name = br.stringAt(raw[0]);
+    occurrenceCount = raw[3];
+    firstOccurrence = raw[4];
 }
 
-LocalVariableDefEntry::LocalVariableDefEntry(BinaryReader& br)
+LocalVariableDefEntry::LocalVariableDefEntry(const BinaryReader& br, const uint32_t* raw)
 {
-    type = br.read<VariableType>();
-    name = br.readStringPtr();
+    type = VariableType(raw[0]);
+    name = br.stringAt(raw[1]);
 }
 
 LocalScriptDefEntry::LocalScriptDefEntry(BinaryReader& br)
@@ -469,9 +568,12 @@ LocalScriptDefEntry::LocalScriptDefEntry(BinaryReader& br)
     int localsCount = br.read<uint32_t>();
     name = br.readStringPtr();
 
+    const int stride = LocalVariableDefEntry::static_size / sizeof(uint32_t);
+    std::vector<uint32_t> raw = br.readArray<uint32_t>(localsCount * stride);
+
     refVar.reserve(localsCount);
     for (int i = 0; i < localsCount; ++i)
 	{
-        refVar.push_back(LocalVariableDefEntry(br));
+        refVar.push_back(LocalVariableDefEntry(br, &raw[i * stride]));
     }
 }
@@ -6,7 +6,7 @@
 #include "gmform/16/gmform16.h"
 
 
-GmForm::ptr_t GmForm::Read(BinaryReader& br)
+GmForm::ptr_t GmForm::Read(BinaryReader& br, std::string const& cachePath)
 {
     GmHeader header(br);
     ASSERT(header.nameCode == static_cast<uint32_t>(SectionHeader::Form));
@@ -19,7 +19,7 @@ GmForm::ptr_t GmForm::Read(BinaryReader& br)
     {
     case 16:
         {
-            return ptr_t(new GmForm16(br));
+            return ptr_t(new GmForm16(br, cachePath));
         }
         break;
 
@@ -33,3 +33,18 @@ GmForm::ptr_t GmForm::Read(BinaryReader& br)
         }
     }
 }
+
+std::string const& GmForm::symbolName(AsmCommand const& cmd) const
+{
+    static const std::string unresolved;
+
+    if (!cmd.hasSymbol())
+    {
+        return unresolved;
+    }
+    if (cmd.operation() == Operation::Call)
+    {
+        return functions().refFunc.at(cmd.symbolIndex()).name;
+    }
+    return variables().refVar.at(cmd.symbolIndex()).name;
+}
@@ -12,3 +12,48 @@ GmHeader::GmHeader(BinaryReader& br)
         char(nameCode >> 24)
     })
 {}
+
+
+GmChunkDirectory::GmChunkDirectory(BinaryReader& br, GmHeader const& form)
+    : entries_()
+{
+    int64_t pos = br.tell();
+    int64_t pastTheEnd = pos + form.size;
+    if (pastTheEnd > static_cast<int64_t>(br.size()))
+    {
+        throw std::runtime_error("FORM extends past the end of the file");
+    }
+
+    while (pos + HEADER_SIZE <= pastTheEnd)
+    {
+        br.seek(int(pos));
+        GmHeader hdr(br);
+        /* Sizes come from the file: a corrupt one must not wrap or
+         * point outside the form */
+        int64_t size = int64_t(hdr.size) + HEADER_SIZE;
+        if (pos + size > pastTheEnd)
+        {
+            throw std::runtime_error("Chunk " + hdr.nameString + " extends past the end of FORM");
+        }
+
+        entries_[SectionHeader(hdr.nameCode)] = Entry{ int(pos), int(size) };
+        pos += size;
+    }
+}
+
+bool GmChunkDirectory::contains(SectionHeader hdr) const
+{
+    return entries_.find(hdr) != entries_.end();
+}
+
+GmChunkDirectory::Entry const& GmChunkDirectory::at(SectionHeader hdr) const
+{
+    auto it = entries_.find(hdr);
+    if (it == entries_.end())
+    {
+        uint32_t code = static_cast<uint32_t>(hdr);
+        std::string name{ char(code & 0xff), char((code >> 8) & 0xff), char((code >> 16) & 0xff), char(code >> 24) };
+        throw std::runtime_error("Chunk " + name + " not found");
+    }
+    return it->second;
+}
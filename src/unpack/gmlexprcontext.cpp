@@ -1,14 +1,13 @@
 #include "gmlwriter.h"
 
 #include <string>
+#include <ostream>
 
 using namespace std;
 
 
-const char* ExprContext::ValueInContext(int val, Type ctx)
+bool ExprContext::WriteValueInContext(std::ostream& out, int val, Type ctx)
 {
-    static string flags;
-
     const auto itab = contextVal_.find(ctx);
     if (itab != contextVal_.end()) 
 	{
@@ -17,43 +16,62 @@ const char* ExprContext::ValueInContext(int val, Type ctx)
 
         if (it != tab.end()) 
 		{
-            return it->second.c_str();
+            out << it->second;
+            return true;
         }
     }
 
     const auto itab2 = flagVal_.find(ctx);
-    if (itab2 != flagVal_.end()) 
+    if (itab2 == flagVal_.end()) 
 	{
-        flags.clear();
-        int hits = 0;
+        return false;
+    }
+    const auto& flags = itab2->second;
 
-        for (const auto& it : itab2->second) 
+    if (val == 0) 
+	{
+        const auto it = flags.find(0);
+        if (it == flags.end()) 
 		{
-            if (val & it.first) 
-			{
-                if (hits > 0) 
-				{
-                    flags += " | ";
-                }
-                flags += it.second;
-                val -= it.first;
-            }
+            return false;
         }
+        out << it->second;
+        return true;
+    }
 
-        if (val) 
+    /* Nothing is written unless the flags make up the whole value */
+    int rest = val;
+    int hits = 0;
+    for (const auto& it : flags) 
+	{
+        if (rest & it.first) 
 		{
-            return nullptr;
+            rest -= it.first;
+            ++hits;
         }
+    }
+    if (rest) 
+	{
+        return false;
+    }
 
-        if (hits > 1) 
+    if (hits > 1) 
+	{
+        out << "(";
+    }
+    rest = val;
+    for (const auto& it : flags) 
+	{
+        if (rest & it.first) 
 		{
-            flags.insert(0, "(");
-            flags += ")";
+            rest -= it.first;
+            out << it.second << (rest ? " | " : "");
         }
-
-        return flags.c_str();
     }
-
-    return nullptr;
+    if (hits > 1) 
+	{
+        out << ")";
+    }
+    return true;
 }
 
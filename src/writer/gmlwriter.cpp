@@ -60,8 +60,14 @@ void GmlWriter::writeLocalVariables(const GmAST& ast)
 void GmlWriter::writeDatetime()
 {
     time_t now = system_clock::to_time_t(system_clock::now());
+    tm utc;
+#ifdef __WINNT
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
     beginLine("/*** ");
-    out() << put_time(gmtime(&now), "%Y-%m-%d %H:%M:%S");
+    out() << put_time(&utc, "%Y-%m-%d %H:%M:%S");
     endLine(" ***/");
 }
 
@@ -132,7 +138,7 @@ void GmlWriter::writeScope(const GmAST& ast)
             if (t != InstanceType::Local &&
                 (t != InstanceType::Self || locals_.find(ast.uplink_->dataString()) != locals_.end()))
 			{
-                out() << InstanceType2PrettyString(t) << ".";
+                out() << t << ".";
             }
         }
 		else if (const char* obj = queryForm(itype, ExprContext::Object))
@@ -213,10 +219,8 @@ void GmlWriter::writeExpression(const GmAST& ast, ExprContext::Type ctx)
         return;
     }
 
-    const char* val = ExprContext::ValueInContext(n, ctx);
-    if (val)
+    if (ExprContext::WriteValueInContext(out(), n, ctx))
 	{
-        out() << val;
         return;
     }
 
@@ -235,7 +239,7 @@ void GmlWriter::writeExpression(const GmAST& ast, ExprContext::Type ctx)
 
     if (ctx == ExprContext::Object && n < 0 && n >= -7)
 	{
-        out() << InstanceType2PrettyString(InstanceType(n));
+        out() << InstanceType(n);
         return;
     }
 
@@ -480,6 +484,12 @@ void GmlWriter::writeCode(const GmAST& ast, bool ind)
         case (GmlPattern::Nop):
             break;
 
+        case (GmlPattern::Comment):
+            beginLine("/* ");
+            out() << ast.dataString();
+            endLine(" */");
+            break;
+
         case (GmlPattern::Switch):
             beginLine("switch (");
             writeExpression(*ast.rightLeaf());
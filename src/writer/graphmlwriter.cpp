@@ -1,6 +1,7 @@
 #include "graphmlwriter.h"
 
 #include <iostream>
+#include <sstream>
 
 #include "gmast.h"
 #include "controltree.h"
@@ -8,8 +9,9 @@
 using namespace std;
 
 
-GraphmlWriter::GraphmlWriter(std::ostream& os)
+GraphmlWriter::GraphmlWriter(std::ostream& os, const GmForm* f)
     : IndentableWriter(os)
+    , form_(f)
 {}
 
 void GraphmlWriter::print(const GmAST& ast)
@@ -24,11 +26,14 @@ void GraphmlWriter::print(const FlowGraph& g)
     enterGraph();
     for(const auto& n : g.nodes_) 
 	{
-        print_node(*n);
+        if(n.alive) 
+		{
+            print_node(n);
+        }
     }
     for(const auto& n : g.nodes_) 
 	{
-        print_outputs(*n);
+        print_outputs(n);
     }
     leave();
 }
@@ -40,6 +45,39 @@ void GraphmlWriter::print(const ControlTree& t)
     leave();
 }
 
+void GraphmlWriter::print(const StepTraceReader::graph_t& g)
+{
+    enterGraph();
+    for(size_t id = 0; id < g.size(); ++id) 
+	{
+        if(g[id].alive) 
+		{
+            ostringstream os;
+            StepTraceReader::print(os, *g[id].tree);
+
+            enterNode(id);
+            writeLabel(os.str());
+            writeNodeLabelGraphics();
+            leave();
+        }
+    }
+    for(size_t id = 0; id < g.size(); ++id) 
+	{
+        bool first = true;
+        for(int out : g[id].outputs) 
+		{
+            enterEdge(id, out);
+            if(!first) 
+			{
+                writeEdgeLineStyleDashed();
+            }
+            first = false;
+            leave();
+        }
+    }
+    leave();
+}
+
 void GraphmlWriter::print_impl(const GmAST& ast)
 {
     size_t id = reinterpret_cast<uintptr_t>(&ast);
@@ -67,7 +105,7 @@ void GraphmlWriter::print_impl(const ControlTree& t)
     enterNode(id);
     if(t.type() == ControlTree::Type::Terminal) 
 	{
-        writeLabel(to_string(t));
+        writeLabel(label(t));
     } 
 	else 
 	{
@@ -90,8 +128,8 @@ void GraphmlWriter::print_impl(const ControlTree& t)
 
 void GraphmlWriter::print_node(const FlowGraph::Node& n)
 {
-    enterNode(reinterpret_cast<uintptr_t>(&n));
-    writeLabel(to_string(*n.tree));
+    enterNode(n.id);
+    writeLabel(label(*n.tree));
     writeNodeLabelGraphics();
     leave();
 }
@@ -101,7 +139,7 @@ void GraphmlWriter::print_outputs(const FlowGraph::Node& n)
     bool first = true;
     for(const auto ptr : n.outputs) 
 	{
-        enterEdge(reinterpret_cast<uintptr_t>(&n), reinterpret_cast<uintptr_t>(ptr));
+        enterEdge(n.id, ptr->id);
         if(!first) 
 		{
             writeEdgeLineStyleDashed();
@@ -111,6 +149,13 @@ void GraphmlWriter::print_outputs(const FlowGraph::Node& n)
     }
 }
 
+string GraphmlWriter::label(const ControlTree& t)
+{
+    ostringstream os;
+    t.print(os, form_);
+    return os.str();
+}
+
 void GraphmlWriter::enter(const string& t)
 {
     out() << indent() << t << " [\n";
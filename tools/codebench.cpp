@@ -0,0 +1,143 @@
+/* Reads and decodes the CODE chunk of a data.win several times over:
+ * byte by byte as BinaryReader used to, word by word with read<T>(), in
+ * bulk with read<T>(p, n), and through Disassemble. Prints the time per
+ * pass of each. */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "gmform.h"
+#include "binaryreader.h"
+#include "asmcommand.h"
+
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /* The per-value read BinaryReader had before bulk reads */
+    struct BytewiseCursor
+    {
+        const char* data;
+        size_t size;
+        size_t ptr;
+
+        uint32_t read()
+        {
+            ASSERT(ptr + sizeof(uint32_t) <= size);
+            uint32_t ret;
+            char* p = reinterpret_cast<char*>(&ret);
+            for (unsigned i = 0; i < sizeof(uint32_t); ++i)
+            {
+                p[i] = data[ptr++];
+            }
+            return ret;
+        }
+    };
+
+    template<class F>
+    void measure(const char* label, int passes, uint64_t words, F&& pass)
+    {
+        uint64_t check = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < passes; ++i)
+        {
+            check += pass();
+        }
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / passes;
+
+        std::cout << std::left << std::setw(14) << label
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(10) << ms << " ms/pass"
+                  << std::setw(10) << std::setprecision(2) << ms * 1e6 / words << " ns/word"
+                  << "   (" << check / passes << ")\n";
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: codebench <data.win> [passes]\n";
+        return 1;
+    }
+    const int passes = argc > 2 ? std::max(1, atoi(argv[2])) : 20;
+
+    BinaryReader br(argv[1]);
+    auto f = GmForm::Read(br);
+    GmCodeChunk const& code = f->code();
+
+    uint64_t words = 0;
+    for (ScriptEntry const& src : code)
+    {
+        words += src.codeSize / 4;
+    }
+    std::cout << code.count() << " scripts, " << words << " words, " << passes << " passes\n";
+    if (!words)
+    {
+        return 0;
+    }
+
+    measure("bytewise", passes, words, [&]()
+    {
+        uint64_t sum = 0;
+        BytewiseCursor cursor{ br.view(0, br.size()), br.size(), 0 };
+        for (ScriptEntry const& src : code)
+        {
+            cursor.ptr = src.codeOffset;
+            for (uint32_t i = 0; i < src.codeSize / 4; ++i)
+            {
+                sum += cursor.read();
+            }
+        }
+        return sum;
+    });
+
+    measure("read<T>()", passes, words, [&]()
+    {
+        uint64_t sum = 0;
+        for (ScriptEntry const& src : code)
+        {
+            BinaryReader cursor(br, src.codeOffset);
+            for (uint32_t i = 0; i < src.codeSize / 4; ++i)
+            {
+                sum += cursor.read<uint32_t>();
+            }
+        }
+        return sum;
+    });
+
+    std::vector<uint32_t> buf;
+    measure("read<T>(p, n)", passes, words, [&]()
+    {
+        uint64_t sum = 0;
+        for (ScriptEntry const& src : code)
+        {
+            BinaryReader cursor(br, src.codeOffset);
+            buf.resize(src.codeSize / 4);
+            cursor.read<uint32_t>(buf.data(), buf.size());
+            for (uint32_t w : buf)
+            {
+                sum += w;
+            }
+        }
+        return sum;
+    });
+
+    measure("Disassemble", passes, words, [&]()
+    {
+        uint64_t count = 0;
+        for (ScriptEntry const& src : code)
+        {
+            BinaryReader cursor(br, src.codeOffset);
+            count += Disassemble(cursor, src.codeOffset + src.codeSize).size();
+        }
+        return count;
+    });
+
+    return 0;
+}
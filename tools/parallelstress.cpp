@@ -0,0 +1,144 @@
+/* Decompiles and exports a data.win with one thread, then again many times
+ * with several, and checks every round writes the same files. Each round
+ * reads the form anew, so lazy chunk loading is raced too. Meant to be
+ * built with -fsanitize=thread (the ParallelStress target). */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "binaryreader.h"
+#include "decompiler.h"
+#include "fsmanager.h"
+#include "gmform.h"
+#include "gmxproject.h"
+#include "utils.h"
+
+
+namespace
+{
+    const char ScriptPrefix[] = "gml_Script_";
+
+    void run(BinaryReader const& data, std::string const& dir, int threads)
+    {
+        BinaryReader br(data, 0);
+        auto f = GmForm::Read(br);
+
+        Decompiler dc(*f);
+        dc.options = Decompiler::Options::Release();
+        dc.options.outputDir = dir + "/log";
+        dc.options.threads = threads;
+
+        GmxProject p;
+        p.options.threads = threads;
+        dc.decompile(p);
+        p.analyzeContexts();
+        p.exportGmx(*f, dir);
+    }
+
+    /* Where exportGmx puts the code of the entry */
+    std::string codePath(std::string const& dir, std::string const& name)
+    {
+        const size_t len = sizeof(ScriptPrefix) - 1;
+        return name.compare(0, len, ScriptPrefix) == 0
+            ? dir + "/scripts/" + name.substr(len) + ".gml"
+            : dir + "/" + name + ".gml";
+    }
+
+    /* Files of an earlier round must not pass for missing ones */
+    void clean(std::string const& dir, std::vector<std::string> const& names)
+    {
+        for (std::string const& name : names)
+        {
+            FsManager::fileDelete(wide(codePath(dir, name)));
+        }
+    }
+
+    /* File without the timestamp lines, empty if missing */
+    std::string contents(std::string const& path)
+    {
+        std::ifstream in(path);
+        std::ostringstream ret;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.compare(0, 5, "/*** ") == 0 && line.size() > 5 && isdigit(line[5]))
+            {
+                continue;
+            }
+            ret << line << "\n";
+        }
+        return ret.str();
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: parallelstress <data.win> <dir> [rounds] [threads]\n";
+        return 1;
+    }
+    const std::string dir = argv[2];
+    const int rounds = argc > 3 ? std::max(1, atoi(argv[3])) : 20;
+    const int threads = argc > 4 ? std::max(2, atoi(argv[4])) : 4;
+
+    BinaryReader br(argv[1]);
+
+    /* Progress of the decompiler is of no interest here */
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    std::streambuf* log = std::clog.rdbuf(nullptr);
+
+    std::vector<std::string> names;
+    {
+        BinaryReader cursor(br, 0);
+        auto f = GmForm::Read(cursor);
+        for (ScriptEntry const& src : f->code())
+        {
+            names.push_back(src.name);
+        }
+    }
+
+    FsManager::directoryCreate(wide(dir));
+    const std::string refDir = dir + "/ref";
+    const std::string runDir = dir + "/run";
+    clean(refDir, names);
+    run(br, refDir, 1);
+
+    std::vector<std::string> expected;
+    for (std::string const& name : names)
+    {
+        expected.push_back(contents(codePath(refDir, name)));
+    }
+
+    int failed = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        clean(runDir, names);
+        run(br, runDir, threads);
+
+        int diffs = 0;
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            if (contents(codePath(runDir, names[i])) != expected[i])
+            {
+                std::cerr << "Round " << round << ": " << names[i] << " differs\n";
+                ++diffs;
+            }
+        }
+        failed += diffs != 0;
+    }
+
+    std::cout.rdbuf(out);
+    std::clog.rdbuf(log);
+
+    std::cerr << rounds << " rounds of " << names.size() << " scripts with " << threads
+              << " threads, " << failed << " failed\n";
+    return failed ? 1 : 0;
+}
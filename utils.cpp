@@ -10,3 +10,38 @@ void string_replace_char(std::string& s, char c, const std::string& rep)
 		}
     }
 }
+
+namespace
+{
+    /* MurmurHash3 finalizer: a bijection in which every input bit
+     * reaches every output bit */
+    uint64_t mix64(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+}
+
+uint64_t hash_bytes(const void* data, size_t n, uint64_t h)
+{
+    const char* p = static_cast<const char*>(data);
+    const uint64_t length = n;
+
+    for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t), p += sizeof(uint64_t))
+    {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        h = mix64(h ^ w);
+    }
+    if (n)
+    {
+        uint64_t w = 0;
+        std::memcpy(&w, p, n);
+        h = mix64(h ^ w);
+    }
+    return mix64(h ^ length);
+}
@@ -2,6 +2,7 @@
 #define TYPES_H_INCLUDED
 
 #include <stdexcept>
+#include <cstdint>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -29,6 +30,10 @@ typedef unsigned char byte;
 
 void string_replace_char(std::string& s, char c, const std::string& rep);
 
+/* Mixes each 64-bit word and the length into the state, so inputs that
+ * differ in any bit collide only by chance. The same on every run */
+uint64_t hash_bytes(const void* data, size_t n, uint64_t h = 0xcbf29ce484222325ull);
+
 template<class V>
 auto vector_pop(V& v)
 {